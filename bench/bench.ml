@@ -0,0 +1,91 @@
+(* Measures the cost of representative stubs and of callback dispatch. Run
+   with "dune build @bench", under xvfb-run on a headless machine. *)
+
+external dispatchCursorPos : GLFW.window -> int -> unit
+  = "caml_benchDispatchCursorPos"
+external dispatchKey : GLFW.window -> int -> unit = "caml_benchDispatchKey"
+
+let iterations = 1_000_000
+
+let report name ~calls ~time ~words =
+  let calls = float_of_int calls in
+  Printf.printf "%-36s %10.1f ns/call %8.2f words/call\n%!"
+    name (time *. 1e9 /. calls) (words /. calls)
+
+let measure ?(iterations = iterations) name f =
+  let words = Gc.minor_words () in
+  let time = GLFW.getTime () in
+  for _ = 1 to iterations do
+    ignore (Sys.opaque_identity (f ()))
+  done;
+  let time = GLFW.getTime () -. time in
+  let words = Gc.minor_words () -. words in
+  report name ~calls:iterations ~time ~words
+
+(* [loop n] makes n calls by itself: callbacks are counted rather than timed
+   individually, [loop] sending synthetic events in a single call, and
+   unboxed results are accumulated in the loop, since returning them
+   through a closure as [measure] does would box them. *)
+let measure_loop name loop =
+  let words = Gc.minor_words () in
+  let time = GLFW.getTime () in
+  loop iterations;
+  let time = GLFW.getTime () -. time in
+  let words = Gc.minor_words () -. words in
+  report name ~calls:iterations ~time ~words
+
+let () =
+  GLFW.init ();
+  at_exit GLFW.terminate;
+  GLFW.windowHint ~hint:GLFW.Visible ~value:false;
+  let window = GLFW.createWindow ~width:64 ~height:64 ~title:"bench" () in
+  GLFW.makeContextCurrent ~window:(Some window);
+  GLFW.swapInterval ~interval:0;
+  let axes = Bigarray.(Array1.create Float32 C_layout 6) in
+  let buttons = Bigarray.(Array1.create Int8_unsigned C_layout 15) in
+  print_endline "Stubs:";
+  measure_loop "getTime" (fun n ->
+      let sum = ref 0. in
+      for _ = 1 to n do
+        sum := !sum +. GLFW.getTime ()
+      done;
+      ignore (Sys.opaque_identity !sum));
+  measure_loop "getTimerValue" (fun n ->
+      let sum = ref 0L in
+      for _ = 1 to n do
+        sum := Int64.add !sum (GLFW.getTimerValue ())
+      done;
+      ignore (Sys.opaque_identity !sum));
+  measure "getCursorPos" (fun () -> GLFW.getCursorPos ~window);
+  measure_loop "getCursorX" (fun n ->
+      let sum = ref 0. in
+      for _ = 1 to n do
+        sum := !sum +. GLFW.getCursorX ~window
+      done;
+      ignore (Sys.opaque_identity !sum));
+  measure "getKey" (fun () -> GLFW.getKey ~window ~key:GLFW.Space);
+  measure "windowShouldClose" (fun () -> GLFW.windowShouldClose ~window);
+  measure "getGamepadState" (fun () -> GLFW.getGamepadState ~joy:0);
+  measure "getGamepadStateInto" (fun () ->
+      GLFW.getGamepadStateInto ~joy:0 ~buttons ~axes);
+  print_endline "Callbacks:";
+  let positions = ref 0 and keys = ref 0 in
+  ignore (GLFW.setCursorPosCallback ~window
+            ~f:(Some (fun _ _ _ -> incr positions)));
+  measure_loop "cursor position" (dispatchCursorPos window);
+  GLFW.setEventCoalescing ~window ~enabled:true;
+  measure_loop "cursor position, coalesced" (fun n ->
+      dispatchCursorPos window n; GLFW.pollEvents ());
+  GLFW.setEventCoalescing ~window ~enabled:false;
+  ignore (GLFW.setKeyCallback ~window
+            ~f:(Some (fun _ _ _ _ _ -> incr keys)));
+  measure_loop "key, modifier list" (dispatchKey window);
+  ignore (GLFW.setKeyCallback ~window ~f:None);
+  ignore (GLFW.setKeyBitsCallback ~window
+            ~f:(Some (fun _ _ _ _ _ -> incr keys)));
+  measure_loop "key, modifier bitset" (dispatchKey window);
+  print_endline "Frame loop:";
+  measure ~iterations:10_000 "pollEvents + swapBuffers" (fun () ->
+      GLFW.pollEvents ();
+      GLFW.swapBuffers ~window);
+  GLFW.destroyWindow ~window
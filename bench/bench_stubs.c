@@ -0,0 +1,31 @@
+#include <GLFW/glfw3.h>
+#include <caml/mlvalues.h>
+
+/* Synthetic events: the callback GLFW would call for a window is fetched by
+   setting a NULL callback and restoring it, then called in a loop as if the
+   events came from the platform. */
+
+CAMLprim value caml_benchDispatchCursorPos(value ml_window, value count)
+{
+    GLFWwindow* window = (GLFWwindow*)(ml_window & ~1);
+    GLFWcursorposfun callback = glfwSetCursorPosCallback(window, NULL);
+
+    glfwSetCursorPosCallback(window, callback);
+    if (callback != NULL)
+        for (intnat i = 0; i < Long_val(count); ++i)
+            callback(window, (double)i, (double)i);
+    return Val_unit;
+}
+
+CAMLprim value caml_benchDispatchKey(value ml_window, value count)
+{
+    GLFWwindow* window = (GLFWwindow*)(ml_window & ~1);
+    GLFWkeyfun callback = glfwSetKeyCallback(window, NULL);
+
+    glfwSetKeyCallback(window, callback);
+    if (callback != NULL)
+        for (intnat i = 0; i < Long_val(count); ++i)
+            callback(window, GLFW_KEY_A, 0, i & 1 ? GLFW_RELEASE : GLFW_PRESS,
+                     GLFW_MOD_SHIFT);
+    return Val_unit;
+}
@@ -1,5 +1,3 @@
-external glClearColorBufferBit : unit -> unit = "caml_glClearColorBufferBit"
-
 let () =
   (* Initialize the library *)
   GLFW.init ();
@@ -8,10 +6,12 @@ let () =
   let window = GLFW.createWindow 640 480 "Hello World" () in
   (* Make the window's context current *)
   GLFW.makeContextCurrent (Some window);
+  (* Load the OpenGL functions of the context *)
+  ignore (GLFW_GL.load ());
   (* Loop until the user closes the window *)
   while not (GLFW.windowShouldClose window) do
     (* Render here *)
-    glClearColorBufferBit ();
+    GLFW_GL.clear GLFW_GL.color_buffer_bit;
     (* Swap front and back buffers *)
     GLFW.swapBuffers window;
     (* Poll for and process events *)
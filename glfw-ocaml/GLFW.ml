@@ -13,6 +13,22 @@ exception PlatformError of string
 exception FormatUnavailable of string
 exception NoWindowContext of string
 
+module Error =
+  struct
+    type t =
+      | NoError
+      | NotInitialized
+      | NoCurrentContext
+      | InvalidEnum
+      | InvalidValue
+      | OutOfMemory
+      | ApiUnavailable
+      | VersionUnavailable
+      | PlatformError
+      | FormatUnavailable
+      | NoWindowContext
+  end
+
 type key_action =
   | Release
   | Press
@@ -147,6 +163,37 @@ type key_mod =
   | Alt
   | Super
 
+module Mods =
+  struct
+    type t = int
+
+    let empty = 0
+    let shift = 0x01
+    let control = 0x02
+    let alt = 0x04
+    let super = 0x08
+    let caps_lock = 0x10
+    let num_lock = 0x20
+
+    let mem flags mods = mods land flags = flags
+    let union = ( lor )
+    let inter = ( land )
+    let diff a b = a land lnot b
+    let is_empty mods = mods = 0
+
+    let of_key_mod = function
+      | Shift -> shift
+      | Control -> control
+      | Alt -> alt
+      | Super -> super
+
+    let of_list = List.fold_left (fun acc m -> acc lor of_key_mod m) empty
+
+    let to_list mods =
+      List.filter (fun m -> mem (of_key_mod m) mods)
+        [Super; Alt; Control; Shift]
+  end
+
 let mouse_button_max_count = 8
 
 let mouse_button_left = 0
@@ -334,22 +381,116 @@ module Image =
       else { width; height; pixels }
   end
 
+module BigarrayImage =
+  struct
+    open Bigarray
+
+    type pixels = (int, int8_unsigned_elt, c_layout) Array1.t
+    type t = { width : int; height : int; pixels : pixels }
+
+    let create ~width ~height ~pixels =
+      if width < 0 || height < 0
+      then invalid_arg "BigarrayImage.create: negative dimension."
+      else if width * height * 4 > Array1.dim pixels
+      then invalid_arg "BigarrayImage.create: insufficient pixel data."
+      else { width; height; pixels }
+  end
+
+module DropPaths =
+  struct
+    type t [@@immediate]
+
+    external length : t -> int = "caml_glfwDropPathsLength"
+    external get : t -> int -> string = "caml_glfwDropPathsGet"
+
+    let iter f paths =
+      for i = 0 to length paths - 1 do
+        f (get paths i)
+      done
+
+    module Detached =
+      struct
+        type t [@@immediate]
+
+        external length : t -> int = "caml_glfwDetachedPathsLength"
+          [@@noalloc]
+        external get : t -> int -> string = "caml_glfwDetachedPathsGet"
+        external destroy : t -> unit = "caml_glfwDetachedPathsDestroy"
+
+        let iter f paths =
+          for i = 0 to length paths - 1 do
+            f (get paths i)
+          done
+      end
+
+    external detach : t -> Detached.t = "caml_glfwDropPathsDetach"
+  end
+
 type hat_status =
   | HatUp
   | HatRight
   | HatDown
   | HatLeft
 
+module Hat =
+  struct
+    type t = int
+
+    let centered = 0
+    let up = 0x01
+    let right = 0x02
+    let down = 0x04
+    let left = 0x08
+
+    let mem flags hat = hat land flags = flags
+
+    let to_list hat =
+      List.filter (fun (flag, _) -> mem flag hat)
+        [left, HatLeft; down, HatDown; right, HatRight; up, HatUp]
+      |> List.map snd
+  end
+
 type gamepad_state = {
     buttons : bool array;
     axes : float array;
   }
 
+type joystick_axes =
+  (float, Bigarray.float32_elt, Bigarray.c_layout) Bigarray.Array1.t
+type joystick_buttons =
+  (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+module JoystickRack =
+  struct
+    open Bigarray
+
+    type axes = (float, float32_elt, c_layout) Array2.t
+    type buttons = (int, int8_unsigned_elt, c_layout) Array2.t
+    type counts = (int, int_elt, c_layout) Array2.t
+    type t = {
+        axes : axes; buttons : buttons; hats : buttons; counts : counts
+      }
+
+    let make ~axes ~buttons ~hats =
+      let rows = joystick_max_count in
+      if axes < 0 || buttons < 0 || hats < 0
+      then invalid_arg "JoystickRack.make: negative dimension."
+      else {
+          axes = Array2.create Float32 C_layout rows axes;
+          buttons = Array2.create Int8_unsigned C_layout rows buttons;
+          hats = Array2.create Int8_unsigned C_layout rows hats;
+          counts = Array2.create Int C_layout rows 3;
+        }
+  end
+
 external init : unit -> unit = "caml_glfwInit"
 external terminate : unit -> unit = "caml_glfwTerminate"
 external initHint : hint:'a init_hint -> value:'a -> unit = "caml_glfwInitHint"
 external getVersion : unit -> int * int * int = "caml_glfwGetVersion"
 external getVersionString : unit -> string = "caml_glfwGetVersionString"
+external getError : unit -> Error.t = "caml_glfwGetError" [@@noalloc]
+external getErrorDescription : unit -> string
+  = "caml_glfwGetErrorDescription"
 external getMonitors : unit -> monitor list = "caml_glfwGetMonitors"
 external getPrimaryMonitor : unit -> monitor = "caml_glfwGetPrimaryMonitor"
 external getMonitorPos : monitor:monitor -> int * int = "caml_glfwGetMonitorPos"
@@ -359,6 +500,12 @@ external getMonitorPhysicalSize : monitor:monitor -> int * int
   = "caml_glfwGetMonitorPhysicalSize"
 external getMonitorContentScale : monitor:monitor -> float * float
   = "caml_glfwGetMonitorContentScale"
+external getMonitorContentScaleX : monitor:monitor -> float
+  = "caml_glfwGetMonitorContentScaleX_byte" "caml_glfwGetMonitorContentScaleX"
+  [@@unboxed]
+external getMonitorContentScaleY : monitor:monitor -> float
+  = "caml_glfwGetMonitorContentScaleY_byte" "caml_glfwGetMonitorContentScaleY"
+  [@@unboxed]
 external getMonitorName : monitor:monitor -> string = "caml_glfwGetMonitorName"
 external setMonitorCallback :
   f:(monitor -> connection_event -> unit) option
@@ -367,7 +514,8 @@ external setMonitorCallback :
 external getVideoModes : monitor:monitor -> video_mode list
   = "caml_glfwGetVideoModes"
 external getVideoMode : monitor:monitor -> video_mode = "caml_glfwGetVideoMode"
-external setGamma : monitor:monitor -> gamma:float -> unit = "caml_glfwSetGamma"
+external setGamma : monitor:monitor -> gamma:float -> unit
+  = "caml_glfwSetGamma_byte" "caml_glfwSetGamma" [@@unboxed]
 external getGammaRamp : monitor:monitor -> GammaRamp.t = "caml_glfwGetGammaRamp"
 external setGammaRamp : monitor:monitor -> gamma_ramp:GammaRamp.t -> unit
   = "caml_glfwSetGammaRamp"
@@ -387,6 +535,9 @@ external setWindowTitle : window:window -> title:string -> unit
   = "caml_glfwSetWindowTitle"
 external setWindowIcon : window:window -> images:Image.t list -> unit
   = "caml_glfwSetWindowIcon"
+external setWindowIconBigarray :
+  window:window -> images:BigarrayImage.t list -> unit
+  = "caml_glfwSetWindowIconBigarray"
 external getWindowPos : window:window -> int * int = "caml_glfwGetWindowPos"
 external setWindowPos : window:window -> xpos:int -> ypos:int -> unit
   = "caml_glfwSetWindowPos"
@@ -405,9 +556,16 @@ external getWindowFrameSize : window:window -> int * int * int * int
   = "caml_glfwGetWindowFrameSize"
 external getWindowContentScale : window:window -> float * float
   = "caml_glfwGetWindowContentScale"
-external getWindowOpacity : window:window -> float = "caml_glfwGetWindowOpacity"
+external getWindowContentScaleX : window:window -> float
+  = "caml_glfwGetWindowContentScaleX_byte" "caml_glfwGetWindowContentScaleX"
+  [@@unboxed]
+external getWindowContentScaleY : window:window -> float
+  = "caml_glfwGetWindowContentScaleY_byte" "caml_glfwGetWindowContentScaleY"
+  [@@unboxed]
+external getWindowOpacity : window:window -> float
+  = "caml_glfwGetWindowOpacity_byte" "caml_glfwGetWindowOpacity" [@@unboxed]
 external setWindowOpacity : window:window -> opacity:float -> unit
-  = "caml_glfwSetWindowOpacity"
+  = "caml_glfwSetWindowOpacity_byte" "caml_glfwSetWindowOpacity" [@@unboxed]
 external iconifyWindow : window:window -> unit = "caml_glfwIconifyWindow"
 external restoreWindow : window:window -> unit = "caml_glfwRestoreWindow"
 external maximizeWindow : window:window -> unit = "caml_glfwMaximizeWindow"
@@ -465,7 +623,7 @@ external setWindowContentScaleCallback :
 external pollEvents : unit -> unit = "caml_glfwPollEvents"
 external waitEvents : unit -> unit = "caml_glfwWaitEvents"
 external waitEventsTimeout : timeout:float -> unit
-  = "caml_glfwWaitEventsTimeout"
+  = "caml_glfwWaitEventsTimeout_byte" "caml_glfwWaitEventsTimeout" [@@unboxed]
 external postEmptyEvent : unit -> unit = "caml_glfwPostEmptyEvent"
 external getInputMode : window:window -> mode:'a input_mode -> 'a
   = "caml_glfwGetInputMode"
@@ -480,10 +638,17 @@ external getKey : window:window -> key:key -> bool = "caml_glfwGetKey"
 external getMouseButton : window:window -> button:int -> bool
   = "caml_glfwGetMouseButton"
 external getCursorPos : window:window -> float * float = "caml_glfwGetCursorPos"
+external getCursorX : window:window -> float
+  = "caml_glfwGetCursorX_byte" "caml_glfwGetCursorX" [@@unboxed]
+external getCursorY : window:window -> float
+  = "caml_glfwGetCursorY_byte" "caml_glfwGetCursorY" [@@unboxed]
 external setCursorPos : window:window -> xpos:float -> ypos:float -> unit
-  = "caml_glfwSetCursorPos"
+  = "caml_glfwSetCursorPos_byte" "caml_glfwSetCursorPos" [@@unboxed]
 external createCursor : image:Image.t -> xhot:int -> yhot:int -> cursor
   = "caml_glfwCreateCursor"
+external createCursorBigarray :
+  image:BigarrayImage.t -> xhot:int -> yhot:int -> cursor
+  = "caml_glfwCreateCursorBigarray"
 external createStandardCursor : shape:cursor_shape -> cursor
   = "caml_glfwCreateStandardCursor"
 external destroyCursor : cursor:cursor -> unit = "caml_glfwDestroyCursor"
@@ -494,6 +659,11 @@ external setKeyCallback :
   -> f:(window -> key -> int -> key_action -> key_mod list -> unit) option
   -> (window -> key -> int -> key_action -> key_mod list -> unit) option
   = "caml_glfwSetKeyCallback"
+external setKeyBitsCallback :
+  window:window
+  -> f:(window -> key -> int -> key_action -> Mods.t -> unit) option
+  -> (window -> key -> int -> key_action -> Mods.t -> unit) option
+  = "caml_glfwSetKeyBitsCallback"
 external setCharCallback :
   window:window -> f:(window -> int -> unit) option
   -> (window -> int -> unit) option
@@ -502,10 +672,18 @@ external setCharModsCallback :
   window:window -> f:(window -> int -> key_mod list -> unit) option
   -> (window -> int -> key_mod list -> unit) option
   = "caml_glfwSetCharModsCallback" [@@deprecated]
+external setCharModsBitsCallback :
+  window:window -> f:(window -> int -> Mods.t -> unit) option
+  -> (window -> int -> Mods.t -> unit) option
+  = "caml_glfwSetCharModsBitsCallback" [@@deprecated]
 external setMouseButtonCallback :
   window:window -> f:(window -> int -> bool -> key_mod list -> unit) option
   -> (window -> int -> bool -> key_mod list -> unit) option
   = "caml_glfwSetMouseButtonCallback"
+external setMouseButtonBitsCallback :
+  window:window -> f:(window -> int -> bool -> Mods.t -> unit) option
+  -> (window -> int -> bool -> Mods.t -> unit) option
+  = "caml_glfwSetMouseButtonBitsCallback"
 external setCursorPosCallback :
   window:window -> f:(window -> float -> float -> unit) option
   -> (window -> float -> float -> unit) option
@@ -518,16 +696,31 @@ external setScrollCallback :
   window:window -> f:(window -> float -> float -> unit) option
   -> (window -> float -> float -> unit) option
   = "caml_glfwSetScrollCallback"
+external setEventCoalescing : window:window -> enabled:bool -> unit
+  = "caml_glfwSetEventCoalescing"
 external setDropCallback :
   window:window -> f:(window -> string list -> unit) option
   -> (window -> string list -> unit) option
   = "caml_glfwSetDropCallback"
+external setDropPathsCallback :
+  window:window -> f:(window -> DropPaths.t -> unit) option
+  -> (window -> DropPaths.t -> unit) option
+  = "caml_glfwSetDropPathsCallback"
 external joystickPresent : joy:int -> bool = "caml_glfwJoystickPresent"
 external getJoystickAxes : joy:int -> float array = "caml_glfwGetJoystickAxes"
 external getJoystickButtons : joy:int -> bool array
   = "caml_glfwGetJoystickButtons"
 external getJoystickHats : joy:int -> hat_status list array
   = "caml_glfwGetJoystickHats"
+external getJoystickHatsBits : joy:int -> Hat.t array
+  = "caml_glfwGetJoystickHatsBits"
+external getJoystickAxesInto : joy:int -> axes:joystick_axes -> int
+  = "caml_glfwGetJoystickAxesInto"
+external getJoystickButtonsInto : joy:int -> buttons:joystick_buttons -> int
+  = "caml_glfwGetJoystickButtonsInto"
+external getJoystickHatsInto : joy:int -> hats:joystick_buttons -> int
+  = "caml_glfwGetJoystickHatsInto"
+external pollJoysticks : rack:JoystickRack.t -> int = "caml_glfwPollJoysticks"
 external getJoystickName : joy:int -> string option = "caml_glfwGetJoystickName"
 external getJoystickGUID : joy:int -> string option = "caml_glfwGetJoystickGUID"
 external joystickIsGamepad : joy:int -> bool = "caml_glfwJoystickIsGamepad"
@@ -539,13 +732,20 @@ external updateGamepadMappings : string:string -> unit
   = "caml_glfwUpdateGamepadMappings"
 external getGamepadName : joy:int -> string option = "caml_glfwGetGamepadName"
 external getGamepadState : joy:int -> gamepad_state = "caml_glfwGetGamepadState"
+external getGamepadStateInto :
+  joy:int -> buttons:joystick_buttons -> axes:joystick_axes -> bool
+  = "caml_glfwGetGamepadStateInto"
 external setClipboardString : window:_ -> string:string -> unit
   = "caml_glfwSetClipboardString"
 external getClipboardString : window:_ -> string = "caml_glfwGetClipboardString"
-external getTime : unit -> float = "caml_glfwGetTime"
-external setTime : time:float -> unit = "caml_glfwSetTime"
-external getTimerValue : unit -> int64 = "caml_glfwGetTimerValue"
-external getTimerFrequency : unit -> int64 = "caml_glfwGetTimerFrequency"
+external getTime : unit -> float
+  = "caml_glfwGetTime_byte" "caml_glfwGetTime" [@@unboxed]
+external setTime : time:float -> unit
+  = "caml_glfwSetTime_byte" "caml_glfwSetTime" [@@unboxed]
+external getTimerValue : unit -> int64
+  = "caml_glfwGetTimerValue_byte" "caml_glfwGetTimerValue" [@@unboxed]
+external getTimerFrequency : unit -> int64
+  = "caml_glfwGetTimerFrequency_byte" "caml_glfwGetTimerFrequency" [@@unboxed]
 external makeContextCurrent : window:window option -> unit
   = "caml_glfwMakeContextCurrent"
 external getCurrentContext : unit -> window option
@@ -554,6 +754,685 @@ external swapBuffers : window:window -> unit = "caml_glfwSwapBuffers"
 external swapInterval : interval:int -> unit = "caml_glfwSwapInterval"
 external extensionSupported : extension:string -> bool
   = "caml_glfwExtensionSupported"
+external vulkanSupported : unit -> bool = "caml_glfwVulkanSupported"
+external getRequiredInstanceExtensions : unit -> string list
+  = "caml_glfwGetRequiredInstanceExtensions"
+external getPhysicalDevicePresentationSupport :
+  instance:(nativeint [@unboxed]) -> device:(nativeint [@unboxed])
+  -> queue_family:int -> bool
+  = "caml_glfwGetPhysicalDevicePresentationSupport_byte"
+    "caml_glfwGetPhysicalDevicePresentationSupport"
+external createWindowSurface :
+  instance:(nativeint [@unboxed]) -> window:window -> (int64 [@unboxed])
+  = "caml_glfwCreateWindowSurface_byte" "caml_glfwCreateWindowSurface"
+
+module EventQueue =
+  struct
+    type kind =
+      | WindowPos
+      | WindowSize
+      | WindowClose
+      | WindowRefresh
+      | WindowFocus
+      | WindowIconify
+      | WindowMaximize
+      | FramebufferSize
+      | WindowContentScale
+      | Key
+      | Char
+      | CharMods
+      | MouseButton
+      | CursorPos
+      | CursorEnter
+      | Scroll
+
+    external setCapacity_stub : int -> unit = "caml_glfwEventQueueSetCapacity"
+    external attach : window:window -> unit = "caml_glfwEventQueueAttach"
+    external detach : window:window -> unit = "caml_glfwEventQueueDetach"
+    external length : unit -> int = "caml_glfwEventQueueLength" [@@noalloc]
+    external dropped : unit -> int = "caml_glfwEventQueueDropped" [@@noalloc]
+    external clear : unit -> unit = "caml_glfwEventQueueClear" [@@noalloc]
+    external discard : int -> int -> unit = "caml_glfwEventQueueDiscard"
+      [@@noalloc]
+    external unsafe_kind : int -> kind = "caml_glfwEventQueueKind" [@@noalloc]
+    external unsafe_window : int -> window = "caml_glfwEventQueueWindow"
+      [@@noalloc]
+    external unsafe_int_arg : int -> int -> int = "caml_glfwEventQueueIntArg"
+      [@@noalloc]
+    external unsafe_float_arg : int -> int -> float
+      = "caml_glfwEventQueueFloatArg_byte" "caml_glfwEventQueueFloatArg"
+      [@@unboxed] [@@noalloc]
+    external unsafe_key : int -> int -> key = "caml_glfwEventQueueIntArg"
+      [@@noalloc]
+    external unsafe_key_action : int -> int -> key_action
+      = "caml_glfwEventQueueIntArg" [@@noalloc]
+    external unsafe_mods : int -> int -> Mods.t = "caml_glfwEventQueueIntArg"
+      [@@noalloc]
+
+    let setCapacity ~capacity =
+      if capacity <= 0
+      then invalid_arg "EventQueue.setCapacity: non-positive capacity."
+      else setCapacity_stub capacity
+
+    let check i =
+      if i < 0 || i >= length ()
+      then invalid_arg "EventQueue: index out of bounds."
+
+    let kind i = check i; unsafe_kind i
+    let window i = check i; unsafe_window i
+
+    let intArg i n =
+      check i;
+      if n < 0 || n > 3
+      then invalid_arg "EventQueue.intArg: no such argument."
+      else unsafe_int_arg i n
+
+    let floatArg i n =
+      check i;
+      if n < 0 || n > 1
+      then invalid_arg "EventQueue.floatArg: no such argument."
+      else unsafe_float_arg i n
+
+    let key i =
+      match kind i with
+      | Key -> unsafe_key i 0
+      | _ -> invalid_arg "EventQueue.key: not a key event."
+
+    let keyAction i =
+      match kind i with
+      | Key -> unsafe_key_action i 2
+      | _ -> invalid_arg "EventQueue.keyAction: not a key event."
+
+    let mods i =
+      match kind i with
+      | Key -> unsafe_mods i 3
+      | CharMods -> unsafe_mods i 1
+      | MouseButton -> unsafe_mods i 2
+      | _ -> invalid_arg "EventQueue.mods: event without modifiers."
+
+    let iter f =
+      let count = length () in
+      let dropped = dropped () in
+      let visited = ref 0 in
+      Fun.protect ~finally:(fun () -> discard !visited dropped) (fun () ->
+          while !visited < count do
+            incr visited;
+            f (!visited - 1)
+          done)
+  end
+
+module FramePacer =
+  struct
+    type t [@@immediate]
+
+    external create_stub : float -> int -> t
+      = "caml_glfwFramePacerCreate_byte" "caml_glfwFramePacerCreate" [@@unboxed]
+    external destroy : t -> unit = "caml_glfwFramePacerDestroy" [@@noalloc]
+    external setTargetFps : t -> fps:float -> unit
+      = "caml_glfwFramePacerSetTargetFps_byte" "caml_glfwFramePacerSetTargetFps"
+      [@@unboxed] [@@noalloc]
+    external frame : t -> window:window -> unit = "caml_glfwFramePacerFrame"
+    external lastFrameTime : t -> float
+      = "caml_glfwFramePacerLastFrameTime_byte"
+        "caml_glfwFramePacerLastFrameTime"
+      [@@unboxed] [@@noalloc]
+    external averageFrameTime : t -> float
+      = "caml_glfwFramePacerAverageFrameTime_byte"
+        "caml_glfwFramePacerAverageFrameTime"
+      [@@unboxed] [@@noalloc]
+    external percentile : t -> float -> float
+      = "caml_glfwFramePacerPercentile_byte" "caml_glfwFramePacerPercentile"
+      [@@unboxed] [@@noalloc]
+    external lateFrames : t -> int = "caml_glfwFramePacerLateFrames"
+      [@@noalloc]
+    external frameCount : t -> int = "caml_glfwFramePacerFrameCount"
+      [@@noalloc]
+    external reset : t -> unit = "caml_glfwFramePacerReset" [@@noalloc]
+
+    let create ~target_fps ~history =
+      if history <= 0
+      then invalid_arg "FramePacer.create: non-positive history."
+      else create_stub target_fps history
+  end
+
+module InputSnapshot =
+  struct
+    type t = {
+        keys : bytes;
+        buttons : bytes;
+        cursor : (float, Bigarray.float64_elt, Bigarray.c_layout)
+                   Bigarray.Array1.t;
+      }
+
+    external key_count : unit -> int = "caml_glfwKeyCount" [@@noalloc]
+    external key_of_int : int -> key = "%identity"
+    external key_to_int : key -> int = "%identity"
+    external capture : window:window -> t -> unit = "caml_glfwSnapshotInput"
+
+    let key_count = key_count ()
+
+    let create () = {
+        keys = Bytes.make key_count '\000';
+        buttons = Bytes.make mouse_button_max_count '\000';
+        cursor = Bigarray.(Array1.create Float64 C_layout 2);
+      }
+
+    let pressed s key = Bytes.get s.keys (key_to_int key) <> '\000'
+
+    let buttonPressed s button =
+      if button < 0 || button >= mouse_button_max_count
+      then invalid_arg "InputSnapshot.buttonPressed: no such button."
+      else Bytes.unsafe_get s.buttons button <> '\000'
+
+    let cursorX s = Bigarray.Array1.unsafe_get s.cursor 0
+    let cursorY s = Bigarray.Array1.unsafe_get s.cursor 1
+
+    let diff ~previous ~current f =
+      for i = 1 to key_count - 1 do
+        let state = Bytes.unsafe_get current.keys i in
+        if state <> Bytes.unsafe_get previous.keys i
+        then f (key_of_int i) (state <> '\000')
+      done
+
+    let diffButtons ~previous ~current f =
+      for i = 0 to mouse_button_max_count - 1 do
+        let state = Bytes.unsafe_get current.buttons i in
+        if state <> Bytes.unsafe_get previous.buttons i
+        then f i (state <> '\000')
+      done
+  end
+
+module IconSet =
+  struct
+    type t [@@immediate]
+
+    external create_stub : BigarrayImage.t -> int array -> t
+      = "caml_glfwIconSetCreate"
+    external destroy : t -> unit = "caml_glfwIconSetDestroy" [@@noalloc]
+    external apply : window:window -> t -> unit = "caml_glfwIconSetApply"
+
+    let create ?(sizes = []) image =
+      if image.BigarrayImage.width = 0 || image.BigarrayImage.height = 0
+      then invalid_arg "IconSet.create: empty image."
+      else if List.exists (fun size -> size <= 0) sizes
+      then invalid_arg "IconSet.create: non-positive size."
+      else create_stub image (Array.of_list sizes)
+  end
+
+module AnimatedCursor =
+  struct
+    type t [@@immediate]
+
+    external create_stub : BigarrayImage.t array -> int -> int -> float -> t
+      = "caml_glfwAnimatedCursorCreate_byte" "caml_glfwAnimatedCursorCreate"
+      [@@unboxed]
+    external destroy : t -> unit = "caml_glfwAnimatedCursorDestroy"
+    external set : window:window -> t -> unit = "caml_glfwAnimatedCursorSet"
+
+    let create ~frames ~xhot ~yhot ~frame_duration =
+      if Array.length frames = 0
+      then invalid_arg "AnimatedCursor.create: no frame."
+      else if not (frame_duration > 0.)
+      then invalid_arg "AnimatedCursor.create: non-positive frame duration."
+      else create_stub frames xhot yhot frame_duration
+  end
+
+module Unchecked =
+  struct
+    external joystickPresent : joy:int -> bool
+      = "caml_glfwUncheckedJoystickPresent" [@@noalloc]
+    external joystickIsGamepad : joy:int -> bool
+      = "caml_glfwUncheckedJoystickIsGamepad" [@@noalloc]
+    external getJoystickAxesInto : joy:int -> axes:joystick_axes -> int
+      = "caml_glfwUncheckedGetJoystickAxesInto" [@@noalloc]
+    external getJoystickButtonsInto :
+      joy:int -> buttons:joystick_buttons -> int
+      = "caml_glfwUncheckedGetJoystickButtonsInto" [@@noalloc]
+    external getJoystickHatsInto : joy:int -> hats:joystick_buttons -> int
+      = "caml_glfwUncheckedGetJoystickHatsInto" [@@noalloc]
+    external getGamepadStateInto :
+      joy:int -> buttons:joystick_buttons -> axes:joystick_axes -> bool
+      = "caml_glfwUncheckedGetGamepadStateInto" [@@noalloc]
+    external getKey : window:window -> key:key -> bool
+      = "caml_glfwUncheckedGetKey" [@@noalloc]
+    external getMouseButton : window:window -> button:int -> bool
+      = "caml_glfwUncheckedGetMouseButton" [@@noalloc]
+    external windowShouldClose : window:window -> bool
+      = "caml_glfwUncheckedWindowShouldClose" [@@noalloc]
+  end
+
+module MainThread =
+  struct
+    let pending = Atomic.make []
+
+    let rec post f =
+      let commands = Atomic.get pending in
+      if Atomic.compare_and_set pending commands (f :: commands)
+      then postEmptyEvent ()
+      else post f
+
+    let run () =
+      match Atomic.exchange pending [] with
+      | [] -> ()
+      | commands ->
+         let error = ref None in
+         List.iter (fun f ->
+             try f () with
+             | e -> if !error == None then error := Some e
+           ) (List.rev commands);
+         match !error with
+         | None -> ()
+         | Some e -> raise e
+  end
+
+module Fence =
+  struct
+    type t
+
+    external insert : unit -> t = "caml_glfwFenceInsert"
+    external wait : t -> unit = "caml_glfwFenceWait"
+    external clientWait : t -> timeout:(float [@unboxed]) -> bool
+      = "caml_glfwFenceClientWait_byte" "caml_glfwFenceClientWait"
+    external delete : t -> unit = "caml_glfwFenceDelete"
+  end
+
+module ContextPool =
+  struct
+    type t = {
+        windows : window array;
+        available : window list Atomic.t;
+      }
+
+    let create ~share ~count =
+      if count < 1 then
+        invalid_arg "ContextPool.create: count must be positive.";
+      let windows = ref [] in
+      windowHint ~hint:Visible ~value:false;
+      begin
+        try
+          for _ = 1 to count do
+            windows := createWindow ~width:1 ~height:1 ~title:"" ~share ()
+                       :: !windows
+          done
+        with e ->
+          windowHint ~hint:Visible ~value:true;
+          List.iter (fun window -> destroyWindow ~window) !windows;
+          raise e
+      end;
+      windowHint ~hint:Visible ~value:true;
+      { windows = Array.of_list !windows; available = Atomic.make !windows }
+
+    let destroy pool =
+      Array.iter (fun window -> destroyWindow ~window) pool.windows
+
+    let rec acquire pool =
+      match Atomic.get pool.available with
+      | [] -> None
+      | window :: tl as available ->
+         if Atomic.compare_and_set pool.available available tl then
+           begin
+             makeContextCurrent ~window:(Some window);
+             Some window
+           end
+         else acquire pool
+
+    let release pool window =
+      let fence = Fence.insert () in
+      makeContextCurrent ~window:None;
+      let rec push () =
+        let available = Atomic.get pool.available in
+        if not (Atomic.compare_and_set pool.available available
+                  (window :: available))
+        then push ()
+      in
+      push ();
+      fence
+  end
+
+module EventLoop =
+  struct
+    external displayFd : unit -> Unix.file_descr option
+      = "caml_glfwGetDisplayFd"
+    external wakeupFd : unit -> Unix.file_descr = "caml_glfwGetWakeupFd"
+    external prepareWait : unit -> bool = "caml_glfwEventLoopPrepareWait"
+
+    let fds () =
+      match displayFd () with
+      | None -> [wakeupFd ()]
+      | Some fd -> [fd; wakeupFd ()]
+  end
+
+module MonitorRegistry =
+  struct
+    type 'a view = 'a array
+
+    let length = Array.length
+    let get = Array.get
+    let toList = Array.to_list
+
+    type entry = {
+        monitor : monitor;
+        name : string;
+        position : int * int;
+        workarea : int * int * int * int;
+        physical_size : int * int;
+        content_scale : float * float;
+        current_mode : video_mode;
+        modes : video_mode view;
+      }
+
+    external generation : unit -> int = "caml_glfwMonitorGeneration"
+      [@@noalloc]
+
+    let mode_bits mode = mode.red_bits + mode.green_bits + mode.blue_bits
+
+    let compare_modes a b =
+      match compare (mode_bits a) (mode_bits b) with
+      | 0 ->
+         begin match compare a.width b.width with
+         | 0 ->
+            begin match compare a.height b.height with
+            | 0 -> compare a.refresh_rate b.refresh_rate
+            | c -> c
+            end
+         | c -> c
+         end
+      | c -> c
+
+    let snapshot monitor =
+      let modes = Array.of_list (getVideoModes ~monitor) in
+      Array.stable_sort compare_modes modes;
+      {
+        monitor;
+        name = getMonitorName ~monitor;
+        position = getMonitorPos ~monitor;
+        workarea = getMonitorWorkarea ~monitor;
+        physical_size = getMonitorPhysicalSize ~monitor;
+        content_scale = getMonitorContentScale ~monitor;
+        current_mode = getVideoMode ~monitor;
+        modes;
+      }
+
+    let cache = ref (-1, [||])
+
+    let refresh () =
+      let generation = generation () in
+      let monitors = Array.of_list (List.map snapshot (getMonitors ())) in
+      cache := (generation, monitors);
+      monitors
+
+    let monitors () =
+      match !cache with
+      | generation', monitors when generation' = generation () -> monitors
+      | _ -> refresh ()
+
+    let primary () =
+      let monitors = monitors () in
+      if Array.length monitors = 0 then None else Some monitors.(0)
+
+    let find monitor =
+      let monitors = monitors () in
+      let rec loop i =
+        if i = Array.length monitors then None
+        else if monitors.(i).monitor == monitor then Some monitors.(i)
+        else loop (i + 1)
+      in
+      loop 0
+
+    (* Index of the first of the modes between low and high satisfying p,
+       which must hold for all the modes following one that satisfies it. *)
+    let rec search modes p low high =
+      if low >= high then low
+      else
+        let middle = (low + high) / 2 in
+        if p modes.(middle) then search modes p low middle
+        else search modes p (middle + 1) high
+
+    (* Same ranking as _glfwChooseVideoMode, except that the color depth is
+       compared on the sum of the channels rather than on each of them.
+       Modes are sorted by color depth then resolution, so the closest
+       depths are found on either side of the requested one, and modes of
+       the requested resolution by binary search among those. *)
+    let bestMode entry ~width ~height ?refresh_rate ?(bits = 24) () =
+      let modes = entry.modes in
+      let count = Array.length modes in
+      if count = 0 then invalid_arg "MonitorRegistry.bestMode: no video mode.";
+      let size_diff mode =
+        (mode.width - width) * (mode.width - width)
+        + (mode.height - height) * (mode.height - height)
+      in
+      let refresh_diff mode =
+        match refresh_rate with
+        | Some refresh_rate -> abs (mode.refresh_rate - refresh_rate)
+        | None -> - mode.refresh_rate
+      in
+      let better a b =
+        match compare (size_diff a) (size_diff b) with
+        | 0 -> refresh_diff a < refresh_diff b
+        | c -> c < 0
+      in
+      let best_between low high =
+        let best = ref modes.(low) in
+        for i = low + 1 to high - 1 do
+          if better modes.(i) !best then best := modes.(i)
+        done;
+        !best
+      in
+      let best_of_depth depth =
+        let low = search modes (fun mode -> mode_bits mode >= depth) 0 count in
+        let high =
+          search modes (fun mode -> mode_bits mode > depth) low count
+        in
+        let first =
+          search modes (fun mode ->
+              mode.width > width
+              || (mode.width = width && mode.height >= height)
+            ) low high
+        in
+        let last =
+          search modes (fun mode ->
+              mode.width > width
+              || (mode.width = width && mode.height > height)
+            ) first high
+        in
+        if first < last then best_between first last
+        else best_between low high
+      in
+      let above = search modes (fun mode -> mode_bits mode >= bits) 0 count in
+      if above = count then best_of_depth (mode_bits modes.(count - 1))
+      else if above = 0 then best_of_depth (mode_bits modes.(0))
+      else
+        let depth_above = mode_bits modes.(above)
+        and depth_below = mode_bits modes.(above - 1) in
+        match compare (depth_above - bits) (bits - depth_below) with
+        | 0 ->
+           let mode_below = best_of_depth depth_below
+           and mode_above = best_of_depth depth_above in
+           if better mode_above mode_below then mode_above else mode_below
+        | c when c < 0 -> best_of_depth depth_above
+        | _ -> best_of_depth depth_below
+  end
+
+module Clipboard =
+  struct
+    type buffer =
+      (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+    external fetch : unit -> int = "caml_glfwClipboardFetch"
+    external blit :
+      src_pos:int -> dst:buffer -> dst_pos:int -> len:int -> unit
+      = "caml_glfwClipboardBlit"
+    external set_stub : buffer -> int -> unit = "caml_glfwClipboardSet"
+
+    let set ?len buffer =
+      let len =
+        match len with
+        | None -> Bigarray.Array1.dim buffer
+        | Some len -> len
+      in
+      set_stub buffer len
+  end
+
+module Offscreen =
+  struct
+    type frame =
+      (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+    type handle [@@immediate]
+
+    type t = {
+        handle : handle;
+        frame : frame;
+        on_frame : frame -> unit;
+      }
+
+    external create_stub : int -> int -> int -> handle
+      = "caml_glfwOffscreenCreate"
+    external destroy_stub : handle -> unit = "caml_glfwOffscreenDestroy"
+    external pending : handle -> int = "caml_glfwOffscreenPending" [@@noalloc]
+    external capacity : handle -> int = "caml_glfwOffscreenCapacity"
+      [@@noalloc]
+    external read_stub : handle -> frame -> bool = "caml_glfwOffscreenRead"
+    external collect_stub : handle -> frame -> bool -> bool
+      = "caml_glfwOffscreenCollect"
+
+    let createWindow ?(osmesa = false) ~width ~height () =
+      windowHint ~hint:Visible ~value:false;
+      if osmesa then
+        windowHint ~hint:ContextCreationApi ~value:OSMesaContextApi;
+      let reset_hints () =
+        windowHint ~hint:Visible ~value:true;
+        if osmesa then
+          windowHint ~hint:ContextCreationApi ~value:NativeContextApi
+      in
+      match createWindow ~width ~height ~title:"" () with
+      | window -> reset_hints (); window
+      | exception e -> reset_hints (); raise e
+
+    let create ?(buffers = 2) ~width ~height on_frame =
+      let handle = create_stub width height buffers in
+      let frame =
+        Bigarray.Array1.create Bigarray.int8_unsigned Bigarray.c_layout
+          (width * height * 4)
+      in
+      { handle; frame; on_frame }
+
+    let destroy t = destroy_stub t.handle
+
+    let poll t =
+      while collect_stub t.handle t.frame false do
+        t.on_frame t.frame
+      done
+
+    let finish t =
+      while collect_stub t.handle t.frame true do
+        t.on_frame t.frame
+      done
+
+    let read t =
+      poll t;
+      let capacity = capacity t.handle in
+      if capacity > 0 && pending t.handle = capacity
+         && collect_stub t.handle t.frame true then
+        t.on_frame t.frame;
+      if read_stub t.handle t.frame then
+        t.on_frame t.frame
+
+    let pending t = pending t.handle
+  end
+
+module Probes =
+  struct
+    type snapshot =
+      (int64, Bigarray.int64_elt, Bigarray.c_layout) Bigarray.Array2.t
+
+    external enable : bool -> unit = "caml_glfwProbesEnable" [@@noalloc]
+    external enabled : unit -> bool = "caml_glfwProbesEnabled" [@@noalloc]
+    external reset : unit -> unit = "caml_glfwProbesReset" [@@noalloc]
+    external names_stub : unit -> string array = "caml_glfwProbesNames"
+    external first_callback : unit -> int = "caml_glfwProbesFirstCallback"
+      [@@noalloc]
+    external snapshot : unit -> snapshot = "caml_glfwProbesSnapshot"
+
+    let names = names_stub ()
+    let count = Array.length names
+    let calls = 0
+    let time = 1
+    let buckets = 32
+    let bucket i = 2 + i
+
+    let isCallback i = i >= first_callback ()
+
+    let bucketLimit i = ldexp 1e-9 (i + 1)
+
+    (* Upper bound of the bucket holding the q-quantile of probe i. *)
+    let quantile snapshot i q =
+      let total = Int64.to_float snapshot.{i, calls} in
+      let rec find b seen =
+        let seen = seen +. Int64.to_float snapshot.{i, bucket b} in
+        if b = buckets - 1 || seen >= q *. total then bucketLimit b
+        else find (b + 1) seen
+      in
+      find 0 0.
+
+    let report () =
+      let snapshot = snapshot () in
+      let buffer = Buffer.create 2048 in
+      Printf.bprintf buffer "%-30s %10s %12s %10s %10s %10s\n"
+        "probe" "calls" "total (ms)" "mean (us)" "p50 (us)" "p99 (us)";
+      for i = 0 to count - 1 do
+        let n = snapshot.{i, calls} in
+        if n > 0L then
+          let total = Int64.to_float snapshot.{i, time} *. 1e-9 in
+          Printf.bprintf buffer "%-30s %10Ld %12.3f %10.2f %10.2f %10.2f\n"
+            (if isCallback i then names.(i) ^ " callback" else names.(i))
+            n (total *. 1e3) (total /. Int64.to_float n *. 1e6)
+            (quantile snapshot i 0.5 *. 1e6)
+            (quantile snapshot i 0.99 *. 1e6)
+      done;
+      Buffer.contents buffer
+  end
+
+module Tracing =
+  struct
+    external start : path:string -> unit = "caml_glfwTracingStart"
+    external flush : unit -> unit = "caml_glfwTracingFlush"
+    external stop : unit -> unit = "caml_glfwTracingStop"
+    external tracing : unit -> bool = "caml_glfwTracingTracing" [@@noalloc]
+    external dropped : unit -> int = "caml_glfwTracingDropped" [@@noalloc]
+  end
+
+module Recorder =
+  struct
+    external start : path:string -> unit = "caml_glfwRecorderStart"
+    external stop : unit -> unit = "caml_glfwRecorderStop"
+    external recording : unit -> bool = "caml_glfwRecorderRecording"
+      [@@noalloc]
+  end
+
+module Replayer =
+  struct
+    type t [@@immediate]
+
+    external create : path:string -> t = "caml_glfwReplayerCreate"
+    external destroy : t -> unit = "caml_glfwReplayerDestroy" [@@noalloc]
+    external step_stub : t -> bool = "caml_glfwReplayerStep"
+    external advance_stub : t -> bool = "caml_glfwReplayerAdvance"
+    external resume : unit -> unit = "caml_glfwReplayerResume" [@@noalloc]
+
+    let step t =
+      match step_stub t with
+      | more -> more
+      | exception exn -> resume (); raise exn
+
+    let advance t =
+      match advance_stub t with
+      | more -> more
+      | exception exn -> resume (); raise exn
+
+    let run t =
+      while step t do () done
+  end
 
 external init_stub : unit -> unit = "init_stub" [@@noalloc]
 
@@ -570,4 +1449,5 @@ let () =
   Callback.register_exception "GLFW.PlatformError" (PlatformError "");
   Callback.register_exception "GLFW.FormatUnavailable" (FormatUnavailable "");
   Callback.register_exception "GLFW.NoWindowContext" (NoWindowContext "");
+  Callback.register "GLFW.MainThread.run" MainThread.run;
   init_stub ()
@@ -22,6 +22,25 @@ exception PlatformError of string
 exception FormatUnavailable of string
 exception NoWindowContext of string
 
+(** Error codes, matching the exceptions above. Used by getError to report
+    errors left pending by the functions that do not raise exceptions, such
+    as those of the Unchecked module. *)
+module Error :
+  sig
+    type t =
+      | NoError
+      | NotInitialized
+      | NoCurrentContext
+      | InvalidEnum
+      | InvalidValue
+      | OutOfMemory
+      | ApiUnavailable
+      | VersionUnavailable
+      | PlatformError
+      | FormatUnavailable
+      | NoWindowContext
+  end
+
 (** Key actions.
 
     @see <http://www.glfw.org/docs/latest/group__input.html> *)
@@ -165,6 +184,37 @@ type key_mod =
   | Alt
   | Super
 
+(** Key modifiers as a bitset, as passed to the Bits variants of the input
+    callbacks. Unlike [key_mod list], these never allocate. The caps_lock and
+    num_lock flags are only reported when the LockKeyMods input mode is set.
+
+    @see <http://www.glfw.org/docs/latest/group__mods.html> *)
+module Mods :
+  sig
+    type t = private int
+
+    val empty : t
+    val shift : t
+    val control : t
+    val alt : t
+    val super : t
+    val caps_lock : t
+    val num_lock : t
+
+    (** [mem flags mods] is true if every flag of [flags] is set in [mods]. *)
+    val mem : t -> t -> bool
+    val union : t -> t -> t
+    val inter : t -> t -> t
+    val diff : t -> t -> t
+    val is_empty : t -> bool
+    val of_key_mod : key_mod -> t
+    val of_list : key_mod list -> t
+
+    (** Same order as the lists given to the callbacks. Lock flags are
+        dropped. *)
+    val to_list : t -> key_mod list
+  end
+
 (** Maximum number of buttons handled for a mouse. *)
 val mouse_button_max_count : int
 
@@ -403,6 +453,68 @@ module Image :
     val create : width:int -> height:int -> pixels:bytes -> t
   end
 
+(** Same as Image with pixel data held in a Bigarray, which is handed to GLFW
+    without being copied. Pixels can thus come from outside the OCaml heap,
+    such as a memory-mapped file:
+    {[
+      let fd = Unix.openfile "cursor.rgba" [Unix.O_RDONLY] 0 in
+      let pixels =
+        Unix.map_file fd Bigarray.int8_unsigned Bigarray.c_layout false [|-1|]
+        |> Bigarray.array1_of_genarray
+      in
+      BigarrayImage.create ~width:32 ~height:32 ~pixels
+    ]}
+    Use Bigarray.Array1.sub to skip a file header or to pick one image out of
+    a file holding several. *)
+module BigarrayImage :
+  sig
+    type pixels =
+      (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+    type t = private { width : int; height : int; pixels : pixels }
+
+    (** @raise Invalid_argument if a dimension is negative or if there is not
+        enough data to make an image with the specified dimensions. *)
+    val create : width:int -> height:int -> pixels:pixels -> t
+  end
+
+(** Paths of files dropped on a window, for callbacks set with
+    setDropPathsCallback. Rather than copying every path to the OCaml heap
+    before the callback is called, they are read from GLFW one at a time, so
+    that very large drops can be processed incrementally. *)
+module DropPaths :
+  sig
+    (** Valid only while the callback it was given to runs. Using it
+        afterwards raises Invalid_argument. *)
+    type t [@@immediate]
+
+    external length : t -> int = "caml_glfwDropPathsLength"
+
+    (** @raise Invalid_argument if the index is out of bounds. *)
+    external get : t -> int -> string = "caml_glfwDropPathsGet"
+
+    val iter : (string -> unit) -> t -> unit
+
+    (** Copy of the paths of a drop kept outside the OCaml heap, which
+        remains valid after the callback returned and may be read from any
+        thread, for instance to process the paths in the background. It
+        must be destroyed once done with. *)
+    module Detached :
+      sig
+        type t [@@immediate]
+
+        external length : t -> int = "caml_glfwDetachedPathsLength"
+          [@@noalloc]
+
+        (** @raise Invalid_argument if the index is out of bounds. *)
+        external get : t -> int -> string = "caml_glfwDetachedPathsGet"
+        external destroy : t -> unit = "caml_glfwDetachedPathsDestroy"
+        val iter : (string -> unit) -> t -> unit
+      end
+
+    (** Copies the paths to a Detached.t. *)
+    external detach : t -> Detached.t = "caml_glfwDropPathsDetach"
+  end
+
 (** Hat statuses as returned by getJoystickHats.
 
     @see <http://www.glfw.org/docs/latest/group__input.html#ga2d8d0634bb81c180899aeb07477a67ea> *)
@@ -412,6 +524,25 @@ type hat_status =
   | HatDown
   | HatLeft
 
+(** Hat statuses as a bitset, as returned by getJoystickHatsBits. Diagonal
+    directions are a union of two flags. *)
+module Hat :
+  sig
+    type t = private int
+
+    val centered : t
+    val up : t
+    val right : t
+    val down : t
+    val left : t
+
+    (** [mem flags hat] is true if every flag of [flags] is set in [hat]. *)
+    val mem : t -> t -> bool
+
+    (** Same order as the lists returned by getJoystickHats. *)
+    val to_list : t -> hat_status list
+  end
+
 (** Gamepad state data as returned by getGamepadState.
 
     @see <http://www.glfw.org/docs/latest/structGLFWgamepadstate.html> *)
@@ -420,6 +551,42 @@ type gamepad_state = {
     axes : float array;
   }
 
+(** Caller-owned buffers for the getJoystick*Into and getGamepadStateInto
+    functions, which poll a joystick without allocating. Buttons are 1 when
+    pressed and 0 when released; hats hold the bitsets described by the Hat
+    module. The getJoystick*Into functions return the number of elements
+    written, which is 0 for an absent joystick and at most the dimension of
+    the buffer. getGamepadStateInto returns false and leaves the buffers
+    untouched if the joystick is not a gamepad. pollJoysticks fills a
+    JoystickRack.t and returns a bitmask of the present joysticks. *)
+type joystick_axes =
+  (float, Bigarray.float32_elt, Bigarray.c_layout) Bigarray.Array1.t
+type joystick_buttons =
+  (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+(** Buffers holding the state of every joystick, filled by pollJoysticks.
+    Row i of each matrix belongs to joystick i. Row i of counts holds the
+    number of axes, buttons and hats written for joystick i, all zero if
+    it is not present. Joysticks with more inputs than the matrices have
+    columns are truncated. *)
+module JoystickRack :
+  sig
+    type axes =
+      (float, Bigarray.float32_elt, Bigarray.c_layout) Bigarray.Array2.t
+    type buttons =
+      (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array2.t
+    type counts = (int, Bigarray.int_elt, Bigarray.c_layout) Bigarray.Array2.t
+    type t = private {
+        axes : axes; buttons : buttons; hats : buttons; counts : counts
+      }
+
+    (** Create a rack with room for the given number of axes, buttons and
+        hats per joystick.
+
+        @raise Invalid_argument if a dimension is negative. *)
+    val make : axes:int -> buttons:int -> hats:int -> t
+  end
+
 (** Module functions. These are mostly identical to their original GLFW
     counterparts.
 
@@ -435,13 +602,49 @@ type gamepad_state = {
     deprecated and is no longer used. You may pass the unit value (or anything)
     as the window argument.
 
-    There is no binding for the glfwGetProcAddress function because it would
-    basicaly require to write an entire OpenGL wrapper to make the functions
-    returned by GLFW usable from OCaml. There are numerous OpenGL bindings
-    available for OCaml that you can use instead.
-
-    The Vulkan related functions are not supported as of now but we might look
-    into it at some point.
+    There is no direct binding for the glfwGetProcAddress function since the
+    functions it returns can not be called from OCaml. Instead, the GLFW_GL
+    module generated from gl_functions.txt resolves a list of OpenGL functions
+    with it and exposes them as externals. There are also numerous OpenGL
+    bindings available for OCaml that you can use instead.
+
+    The Vulkan related functions exchange Vulkan handles as integers so that
+    they can be used with any Vulkan binding: VkInstance and VkPhysicalDevice
+    handles are passed as nativeint and the created VkSurfaceKHR is returned
+    as an int64, since non-dispatchable handles are 64-bit wide on every
+    platform. No allocator can be given to createWindowSurface, which raises
+    Failure with the VkResult code on Vulkan errors GLFW does not report
+    itself, such as VK_ERROR_NATIVE_WINDOW_IN_USE_KHR. There is no
+    binding for the glfwGetInstanceProcAddress function, as the functions it
+    returns can not be called from OCaml either.
+
+    The waitEvents, waitEventsTimeout and swapBuffers functions release the
+    OCaml runtime lock while they block, letting other threads run in the
+    meantime. Callbacks invoked from waitEvents and waitEventsTimeout take the
+    lock back for as long as they run. An exception escaping such a callback
+    does not interrupt event processing; the first one is raised once the
+    function returns.
+
+    Errors are kept per thread: an exception is only ever raised in the
+    thread or domain whose call caused the error. The MainThread module
+    lets other threads have the main thread run functions restricted to it.
+
+    The getCursorX, getCursorY, getWindowContentScaleX, getWindowContentScaleY,
+    getMonitorContentScaleX and getMonitorContentScaleY functions return a
+    single component of their tuple returning counterpart. They are meant for
+    per-frame queries and allocate nothing in native code unless they raise.
+
+    getError, like glfwGetError, returns and clears the error left pending
+    by a function that does not raise, such as those of the Unchecked
+    module. getErrorDescription returns the description of the last error
+    reported by GLFW.
+
+    When event coalescing is enabled for a window with setEventCoalescing,
+    its cursor position and scroll callbacks are called at most once per
+    pollEvents, waitEvents or waitEventsTimeout call, with the last cursor
+    position and the sum of the scroll offsets. Pending motion is delivered
+    before any other event of the same window, so it stays ordered with
+    respect to key and mouse button events.
 
     @see <http://www.glfw.org/docs/latest/glfw3_8h.html#func-members> *)
 
@@ -450,6 +653,9 @@ external terminate : unit -> unit = "caml_glfwTerminate"
 external initHint : hint:'a init_hint -> value:'a -> unit = "caml_glfwInitHint"
 external getVersion : unit -> int * int * int = "caml_glfwGetVersion"
 external getVersionString : unit -> string = "caml_glfwGetVersionString"
+external getError : unit -> Error.t = "caml_glfwGetError" [@@noalloc]
+external getErrorDescription : unit -> string
+  = "caml_glfwGetErrorDescription"
 external getMonitors : unit -> monitor list = "caml_glfwGetMonitors"
 external getPrimaryMonitor : unit -> monitor = "caml_glfwGetPrimaryMonitor"
 external getMonitorPos : monitor:monitor -> int * int = "caml_glfwGetMonitorPos"
@@ -459,6 +665,12 @@ external getMonitorPhysicalSize : monitor:monitor -> int * int
   = "caml_glfwGetMonitorPhysicalSize"
 external getMonitorContentScale : monitor:monitor -> float * float
   = "caml_glfwGetMonitorContentScale"
+external getMonitorContentScaleX : monitor:monitor -> float
+  = "caml_glfwGetMonitorContentScaleX_byte" "caml_glfwGetMonitorContentScaleX"
+  [@@unboxed]
+external getMonitorContentScaleY : monitor:monitor -> float
+  = "caml_glfwGetMonitorContentScaleY_byte" "caml_glfwGetMonitorContentScaleY"
+  [@@unboxed]
 external getMonitorName : monitor:monitor -> string = "caml_glfwGetMonitorName"
 external setMonitorCallback :
   f:(monitor -> connection_event -> unit) option
@@ -467,7 +679,8 @@ external setMonitorCallback :
 external getVideoModes : monitor:monitor -> video_mode list
   = "caml_glfwGetVideoModes"
 external getVideoMode : monitor:monitor -> video_mode = "caml_glfwGetVideoMode"
-external setGamma : monitor:monitor -> gamma:float -> unit = "caml_glfwSetGamma"
+external setGamma : monitor:monitor -> gamma:float -> unit
+  = "caml_glfwSetGamma_byte" "caml_glfwSetGamma" [@@unboxed]
 external getGammaRamp : monitor:monitor -> GammaRamp.t = "caml_glfwGetGammaRamp"
 external setGammaRamp : monitor:monitor -> gamma_ramp:GammaRamp.t -> unit
   = "caml_glfwSetGammaRamp"
@@ -487,6 +700,9 @@ external setWindowTitle : window:window -> title:string -> unit
   = "caml_glfwSetWindowTitle"
 external setWindowIcon : window:window -> images:Image.t list -> unit
   = "caml_glfwSetWindowIcon"
+external setWindowIconBigarray :
+  window:window -> images:BigarrayImage.t list -> unit
+  = "caml_glfwSetWindowIconBigarray"
 external getWindowPos : window:window -> int * int = "caml_glfwGetWindowPos"
 external setWindowPos : window:window -> xpos:int -> ypos:int -> unit
   = "caml_glfwSetWindowPos"
@@ -505,9 +721,16 @@ external getWindowFrameSize : window:window -> int * int * int * int
   = "caml_glfwGetWindowFrameSize"
 external getWindowContentScale : window:window -> float * float
   = "caml_glfwGetWindowContentScale"
-external getWindowOpacity : window:window -> float = "caml_glfwGetWindowOpacity"
+external getWindowContentScaleX : window:window -> float
+  = "caml_glfwGetWindowContentScaleX_byte" "caml_glfwGetWindowContentScaleX"
+  [@@unboxed]
+external getWindowContentScaleY : window:window -> float
+  = "caml_glfwGetWindowContentScaleY_byte" "caml_glfwGetWindowContentScaleY"
+  [@@unboxed]
+external getWindowOpacity : window:window -> float
+  = "caml_glfwGetWindowOpacity_byte" "caml_glfwGetWindowOpacity" [@@unboxed]
 external setWindowOpacity : window:window -> opacity:float -> unit
-  = "caml_glfwSetWindowOpacity"
+  = "caml_glfwSetWindowOpacity_byte" "caml_glfwSetWindowOpacity" [@@unboxed]
 external iconifyWindow : window:window -> unit = "caml_glfwIconifyWindow"
 external restoreWindow : window:window -> unit = "caml_glfwRestoreWindow"
 external maximizeWindow : window:window -> unit = "caml_glfwMaximizeWindow"
@@ -565,7 +788,7 @@ external setWindowContentScaleCallback :
 external pollEvents : unit -> unit = "caml_glfwPollEvents"
 external waitEvents : unit -> unit = "caml_glfwWaitEvents"
 external waitEventsTimeout : timeout:float -> unit
-  = "caml_glfwWaitEventsTimeout"
+  = "caml_glfwWaitEventsTimeout_byte" "caml_glfwWaitEventsTimeout" [@@unboxed]
 external postEmptyEvent : unit -> unit = "caml_glfwPostEmptyEvent"
 external getInputMode : window:window -> mode:'a input_mode -> 'a
   = "caml_glfwGetInputMode"
@@ -580,10 +803,17 @@ external getKey : window:window -> key:key -> bool = "caml_glfwGetKey"
 external getMouseButton : window:window -> button:int -> bool
   = "caml_glfwGetMouseButton"
 external getCursorPos : window:window -> float * float = "caml_glfwGetCursorPos"
+external getCursorX : window:window -> float
+  = "caml_glfwGetCursorX_byte" "caml_glfwGetCursorX" [@@unboxed]
+external getCursorY : window:window -> float
+  = "caml_glfwGetCursorY_byte" "caml_glfwGetCursorY" [@@unboxed]
 external setCursorPos : window:window -> xpos:float -> ypos:float -> unit
-  = "caml_glfwSetCursorPos"
+  = "caml_glfwSetCursorPos_byte" "caml_glfwSetCursorPos" [@@unboxed]
 external createCursor : image:Image.t -> xhot:int -> yhot:int -> cursor
   = "caml_glfwCreateCursor"
+external createCursorBigarray :
+  image:BigarrayImage.t -> xhot:int -> yhot:int -> cursor
+  = "caml_glfwCreateCursorBigarray"
 external createStandardCursor : shape:cursor_shape -> cursor
   = "caml_glfwCreateStandardCursor"
 external destroyCursor : cursor:cursor -> unit = "caml_glfwDestroyCursor"
@@ -594,6 +824,11 @@ external setKeyCallback :
   -> f:(window -> key -> int -> key_action -> key_mod list -> unit) option
   -> (window -> key -> int -> key_action -> key_mod list -> unit) option
   = "caml_glfwSetKeyCallback"
+external setKeyBitsCallback :
+  window:window
+  -> f:(window -> key -> int -> key_action -> Mods.t -> unit) option
+  -> (window -> key -> int -> key_action -> Mods.t -> unit) option
+  = "caml_glfwSetKeyBitsCallback"
 external setCharCallback :
   window:window -> f:(window -> int -> unit) option
   -> (window -> int -> unit) option
@@ -602,10 +837,18 @@ external setCharModsCallback :
   window:window -> f:(window -> int -> key_mod list -> unit) option
   -> (window -> int -> key_mod list -> unit) option
   = "caml_glfwSetCharModsCallback" [@@deprecated]
+external setCharModsBitsCallback :
+  window:window -> f:(window -> int -> Mods.t -> unit) option
+  -> (window -> int -> Mods.t -> unit) option
+  = "caml_glfwSetCharModsBitsCallback" [@@deprecated]
 external setMouseButtonCallback :
   window:window -> f:(window -> int -> bool -> key_mod list -> unit) option
   -> (window -> int -> bool -> key_mod list -> unit) option
   = "caml_glfwSetMouseButtonCallback"
+external setMouseButtonBitsCallback :
+  window:window -> f:(window -> int -> bool -> Mods.t -> unit) option
+  -> (window -> int -> bool -> Mods.t -> unit) option
+  = "caml_glfwSetMouseButtonBitsCallback"
 external setCursorPosCallback :
   window:window -> f:(window -> float -> float -> unit) option
   -> (window -> float -> float -> unit) option
@@ -618,16 +861,31 @@ external setScrollCallback :
   window:window -> f:(window -> float -> float -> unit) option
   -> (window -> float -> float -> unit) option
   = "caml_glfwSetScrollCallback"
+external setEventCoalescing : window:window -> enabled:bool -> unit
+  = "caml_glfwSetEventCoalescing"
 external setDropCallback :
   window:window -> f:(window -> string list -> unit) option
   -> (window -> string list -> unit) option
   = "caml_glfwSetDropCallback"
+external setDropPathsCallback :
+  window:window -> f:(window -> DropPaths.t -> unit) option
+  -> (window -> DropPaths.t -> unit) option
+  = "caml_glfwSetDropPathsCallback"
 external joystickPresent : joy:int -> bool = "caml_glfwJoystickPresent"
 external getJoystickAxes : joy:int -> float array = "caml_glfwGetJoystickAxes"
 external getJoystickButtons : joy:int -> bool array
   = "caml_glfwGetJoystickButtons"
 external getJoystickHats : joy:int -> hat_status list array
   = "caml_glfwGetJoystickHats"
+external getJoystickHatsBits : joy:int -> Hat.t array
+  = "caml_glfwGetJoystickHatsBits"
+external getJoystickAxesInto : joy:int -> axes:joystick_axes -> int
+  = "caml_glfwGetJoystickAxesInto"
+external getJoystickButtonsInto : joy:int -> buttons:joystick_buttons -> int
+  = "caml_glfwGetJoystickButtonsInto"
+external getJoystickHatsInto : joy:int -> hats:joystick_buttons -> int
+  = "caml_glfwGetJoystickHatsInto"
+external pollJoysticks : rack:JoystickRack.t -> int = "caml_glfwPollJoysticks"
 external getJoystickName : joy:int -> string option = "caml_glfwGetJoystickName"
 external getJoystickGUID : joy:int -> string option = "caml_glfwGetJoystickGUID"
 external joystickIsGamepad : joy:int -> bool = "caml_glfwJoystickIsGamepad"
@@ -639,13 +897,20 @@ external updateGamepadMappings : string:string -> unit
   = "caml_glfwUpdateGamepadMappings"
 external getGamepadName : joy:int -> string option = "caml_glfwGetGamepadName"
 external getGamepadState : joy:int -> gamepad_state = "caml_glfwGetGamepadState"
+external getGamepadStateInto :
+  joy:int -> buttons:joystick_buttons -> axes:joystick_axes -> bool
+  = "caml_glfwGetGamepadStateInto"
 external setClipboardString : window:_ -> string:string -> unit
   = "caml_glfwSetClipboardString"
 external getClipboardString : window:_ -> string = "caml_glfwGetClipboardString"
-external getTime : unit -> float = "caml_glfwGetTime"
-external setTime : time:float -> unit = "caml_glfwSetTime"
-external getTimerValue : unit -> int64 = "caml_glfwGetTimerValue"
-external getTimerFrequency : unit -> int64 = "caml_glfwGetTimerFrequency"
+external getTime : unit -> float
+  = "caml_glfwGetTime_byte" "caml_glfwGetTime" [@@unboxed]
+external setTime : time:float -> unit
+  = "caml_glfwSetTime_byte" "caml_glfwSetTime" [@@unboxed]
+external getTimerValue : unit -> int64
+  = "caml_glfwGetTimerValue_byte" "caml_glfwGetTimerValue" [@@unboxed]
+external getTimerFrequency : unit -> int64
+  = "caml_glfwGetTimerFrequency_byte" "caml_glfwGetTimerFrequency" [@@unboxed]
 external makeContextCurrent : window:window option -> unit
   = "caml_glfwMakeContextCurrent"
 external getCurrentContext : unit -> window option
@@ -654,5 +919,691 @@ external swapBuffers : window:window -> unit = "caml_glfwSwapBuffers"
 external swapInterval : interval:int -> unit = "caml_glfwSwapInterval"
 external extensionSupported : extension:string -> bool
   = "caml_glfwExtensionSupported"
+external vulkanSupported : unit -> bool = "caml_glfwVulkanSupported"
+external getRequiredInstanceExtensions : unit -> string list
+  = "caml_glfwGetRequiredInstanceExtensions"
+external getPhysicalDevicePresentationSupport :
+  instance:(nativeint [@unboxed]) -> device:(nativeint [@unboxed])
+  -> queue_family:int -> bool
+  = "caml_glfwGetPhysicalDevicePresentationSupport_byte"
+    "caml_glfwGetPhysicalDevicePresentationSupport"
+external createWindowSurface :
+  instance:(nativeint [@unboxed]) -> window:window -> (int64 [@unboxed])
+  = "caml_glfwCreateWindowSurface_byte" "caml_glfwCreateWindowSurface"
+
+(** Batched event delivery.
+
+    Windows attached to the event queue have their events recorded into a
+    fixed-size ring buffer instead of being dispatched to their callbacks.
+    After calling pollEvents or waitEvents, the recorded events can be read
+    back in one pass without any allocation. Drop events are never queued and
+    are still dispatched to the drop callback.
+
+    Events are read by index, 0 being the oldest, with the following
+    accessors. Integer and floating-point arguments are laid out as follows:
+
+    * WindowPos, WindowSize, FramebufferSize: intArg 0 and 1;
+    * WindowFocus, WindowIconify, WindowMaximize, CursorEnter: intArg 0 is 1
+      when the window gained the state and 0 when it lost it;
+    * WindowContentScale, CursorPos, Scroll: floatArg 0 and 1;
+    * Key: key, intArg 1 is the scancode, keyAction and intArg 3 is the
+      modifier bitmask;
+    * Char: intArg 0 is the codepoint;
+    * CharMods: intArg 0 is the codepoint and intArg 1 the modifier bitmask;
+      the modifier bitmask of Key, CharMods and MouseButton events is also
+      available as a Mods.t through mods;
+    * MouseButton: intArg 0 is the button, intArg 1 is 1 on press and 0 on
+      release and intArg 2 is the modifier bitmask. *)
+module EventQueue :
+  sig
+    type kind =
+      | WindowPos
+      | WindowSize
+      | WindowClose
+      | WindowRefresh
+      | WindowFocus
+      | WindowIconify
+      | WindowMaximize
+      | FramebufferSize
+      | WindowContentScale
+      | Key
+      | Char
+      | CharMods
+      | MouseButton
+      | CursorPos
+      | CursorEnter
+      | Scroll
+
+    (** Reallocate the ring buffer to hold the given number of events,
+        discarding any queued event. The default capacity is 1024. Once the
+        buffer is full, new events overwrite the oldest ones.
+
+        @raise Invalid_argument if the capacity is not positive. *)
+    val setCapacity : capacity:int -> unit
+
+    (** Start recording the events of a window into the queue. The callbacks
+        of the window are kept but not called until it is detached. *)
+    external attach : window:window -> unit = "caml_glfwEventQueueAttach"
+
+    (** Stop recording the events of a window and dispatch them to its
+        callbacks again. Events already queued are kept. *)
+    external detach : window:window -> unit = "caml_glfwEventQueueDetach"
+
+    (** Number of events in the queue. *)
+    external length : unit -> int = "caml_glfwEventQueueLength" [@@noalloc]
+
+    (** Number of events overwritten since the queue was last cleared. *)
+    external dropped : unit -> int = "caml_glfwEventQueueDropped" [@@noalloc]
+
+    (** Empty the queue. *)
+    external clear : unit -> unit = "caml_glfwEventQueueClear" [@@noalloc]
+
+    (** Accessors for the event at the given index.
+
+        @raise Invalid_argument if there is no such event or argument. *)
+    val kind : int -> kind
+    val window : int -> window
+    val intArg : int -> int -> int
+    val floatArg : int -> int -> float
+    val key : int -> key
+    val keyAction : int -> key_action
+    val mods : int -> Mods.t
+
+    (** [iter f] calls [f] on the index of every queued event, from the
+        oldest to the newest, then removes them from the queue. Events queued
+        while [f] runs, by a nested pollEvents for instance, are kept. If [f]
+        raises, the events after the one it raised on are kept as well. *)
+    val iter : (int -> unit) -> unit
+  end
+
+(** Frame pacing. A frame pacer limits the frame rate by waiting for events
+    until the next frame is due, and keeps the duration of the last frames
+    to detect late frames and compute statistics. Durations are in seconds
+    and nothing is allocated in native code once the pacer is created.
+
+    A pacer must be destroyed explicitly. *)
+module FramePacer :
+  sig
+    type t [@@immediate]
+
+    (** Create a pacer targeting the given frame rate, 0 meaning no limit,
+        and remembering the duration of the given number of frames.
+
+        @raise Invalid_argument if the history is not positive. *)
+    val create : target_fps:float -> history:int -> t
+
+    external destroy : t -> unit = "caml_glfwFramePacerDestroy" [@@noalloc]
+
+    external setTargetFps : t -> fps:float -> unit
+      = "caml_glfwFramePacerSetTargetFps_byte" "caml_glfwFramePacerSetTargetFps"
+      [@@unboxed] [@@noalloc]
+
+    (** End a frame: swap the buffers of the window, then process events with
+        waitEventsTimeout until the next frame is due. A pacer running more
+        than one frame behind schedule does not try to catch up. A frame is
+        counted as late when it lasts more than one and a half times the
+        target period. Without a target, this only swaps the buffers and
+        records the frame time; events must be processed as usual. *)
+    external frame : t -> window:window -> unit = "caml_glfwFramePacerFrame"
+
+    (** Duration of the last frame, or 0 if there is none yet. *)
+    external lastFrameTime : t -> float
+      = "caml_glfwFramePacerLastFrameTime_byte"
+        "caml_glfwFramePacerLastFrameTime"
+      [@@unboxed] [@@noalloc]
+
+    (** Average duration of the remembered frames. *)
+    external averageFrameTime : t -> float
+      = "caml_glfwFramePacerAverageFrameTime_byte"
+        "caml_glfwFramePacerAverageFrameTime"
+      [@@unboxed] [@@noalloc]
+
+    (** [percentile pacer p] is the nearest-rank [p] percentile of the
+        remembered frame durations, [p] being clamped between 0 and 1, and
+        nan taken as 0: 0.5 gives the median and 0.99 the p99. *)
+    external percentile : t -> float -> float
+      = "caml_glfwFramePacerPercentile_byte" "caml_glfwFramePacerPercentile"
+      [@@unboxed] [@@noalloc]
+
+    (** Number of late frames since the pacer was created or reset. *)
+    external lateFrames : t -> int = "caml_glfwFramePacerLateFrames"
+      [@@noalloc]
+
+    (** Number of remembered frames, at most the size of the history. *)
+    external frameCount : t -> int = "caml_glfwFramePacerFrameCount"
+      [@@noalloc]
+
+    (** Forget the remembered frames and the late frame count. *)
+    external reset : t -> unit = "caml_glfwFramePacerReset" [@@noalloc]
+  end
+
+(** Keyboard and mouse state of a window, captured in a single call instead
+    of calling getKey and getMouseButton for each key and button. A
+    snapshot can be reused across frames and capturing into it allocates
+    nothing. *)
+module InputSnapshot :
+  sig
+    (** Keys are indexed by the position of their constructor in the key
+        type and buttons by their number; a byte is 1 when the key or button
+        is pressed and 0 otherwise. The cursor array holds the cursor
+        position as returned by getCursorPos. *)
+    type t = private {
+        keys : bytes;
+        buttons : bytes;
+        cursor : (float, Bigarray.float64_elt, Bigarray.c_layout)
+                   Bigarray.Array1.t;
+      }
+
+    (** Number of keys, including Unknown which is never pressed. *)
+    val key_count : int
+
+    val create : unit -> t
+
+    (** Capture the current state of a window into a snapshot. *)
+    external capture : window:window -> t -> unit = "caml_glfwSnapshotInput"
+
+    val pressed : t -> key -> bool
+
+    (** @raise Invalid_argument if the button is not below
+        mouse_button_max_count. *)
+    val buttonPressed : t -> int -> bool
+
+    val cursorX : t -> float
+    val cursorY : t -> float
+
+    (** [diff ~previous ~current f] calls [f key pressed] for every key whose
+        state differs between the two snapshots, [pressed] being its state in
+        [current]. *)
+    val diff : previous:t -> current:t -> (key -> bool -> unit) -> unit
+
+    (** Same as diff for mouse buttons. *)
+    val diffButtons : previous:t -> current:t -> (int -> bool -> unit) -> unit
+  end
+
+(** Window icons prepared once and applied to any number of windows. An
+    icon set must be destroyed explicitly; windows keep their icon. *)
+module IconSet :
+  sig
+    type t [@@immediate]
+
+    (** Create a set holding the image scaled to each of the given widths,
+        keeping its aspect ratio, or only the image itself if no size is
+        given. Scaling down averages pixels and scaling up duplicates them.
+        GLFW picks the most suitable image of the set for each use.
+
+        @raise Invalid_argument if the image is empty or if a size is not
+        positive. *)
+    val create : ?sizes:int list -> BigarrayImage.t -> t
+
+    external destroy : t -> unit = "caml_glfwIconSetDestroy" [@@noalloc]
+
+    (** Set the icon of a window from the set. *)
+    external apply : window:window -> t -> unit = "caml_glfwIconSetApply"
+  end
+
+(** Cursors cycling through frames. All frames are created upfront and the
+    cursor of the windows an animated cursor is set on is advanced at the end
+    of pollEvents, waitEvents and waitEventsTimeout. Calling setCursor on a
+    window stops its animation. An animated cursor must be destroyed
+    explicitly, which resets the windows using it to the default cursor. *)
+module AnimatedCursor :
+  sig
+    type t [@@immediate]
+
+    (** Create an animated cursor showing each frame for the given number of
+        seconds, looping forever.
+
+        @raise Invalid_argument if there is no frame or the frame duration is
+        not positive. *)
+    val create :
+      frames:BigarrayImage.t array -> xhot:int -> yhot:int
+      -> frame_duration:float -> t
+
+    external destroy : t -> unit = "caml_glfwAnimatedCursorDestroy"
+    external set : window:window -> t -> unit = "caml_glfwAnimatedCursorSet"
+  end
+
+(** Variants of frequently called functions that never raise an exception
+    and allocate nothing, for loops where errors are routine, such as
+    probing joysticks. They return the same default value as GLFW on
+    error, and the error is left pending: call getError to consume it,
+    otherwise it is raised by the next function checking for errors. *)
+module Unchecked :
+  sig
+    external joystickPresent : joy:int -> bool
+      = "caml_glfwUncheckedJoystickPresent" [@@noalloc]
+    external joystickIsGamepad : joy:int -> bool
+      = "caml_glfwUncheckedJoystickIsGamepad" [@@noalloc]
+    external getJoystickAxesInto : joy:int -> axes:joystick_axes -> int
+      = "caml_glfwUncheckedGetJoystickAxesInto" [@@noalloc]
+    external getJoystickButtonsInto :
+      joy:int -> buttons:joystick_buttons -> int
+      = "caml_glfwUncheckedGetJoystickButtonsInto" [@@noalloc]
+    external getJoystickHatsInto : joy:int -> hats:joystick_buttons -> int
+      = "caml_glfwUncheckedGetJoystickHatsInto" [@@noalloc]
+    external getGamepadStateInto :
+      joy:int -> buttons:joystick_buttons -> axes:joystick_axes -> bool
+      = "caml_glfwUncheckedGetGamepadStateInto" [@@noalloc]
+    external getKey : window:window -> key:key -> bool
+      = "caml_glfwUncheckedGetKey" [@@noalloc]
+    external getMouseButton : window:window -> button:int -> bool
+      = "caml_glfwUncheckedGetMouseButton" [@@noalloc]
+    external windowShouldClose : window:window -> bool
+      = "caml_glfwUncheckedWindowShouldClose" [@@noalloc]
+  end
+
+(** Commands run by the main thread on behalf of other threads or domains.
+
+    Most GLFW functions, such as those creating windows or changing their
+    attributes, may only be called from the main thread. Other threads can
+    instead post them as closures to be run by the main thread the next time
+    it calls pollEvents, waitEvents, waitEventsTimeout or FramePacer.frame,
+    letting a rendering
+    domain own a context while the main domain processes events. *)
+module MainThread :
+  sig
+    (** Queues a command for the main thread and wakes it up if it is waiting
+        for events. It never blocks and may be called from any thread or
+        domain. Commands run in the order they were posted, before events are
+        processed and, for the waiting functions, again once they wake up.
+        Should a command raise an exception, the remaining ones still run,
+        events are processed anyway and the first exception is raised by the
+        event processing function that ran them once it is done. *)
+    val post : (unit -> unit) -> unit
+  end
+
+(** GPU fences, to synchronize contexts sharing their objects.
+
+    These require a context to be current on the calling thread and raise
+    NoCurrentContext otherwise. Contexts without sync objects, below
+    OpenGL 3.2 or OpenGL ES 3.0 and lacking ARB_sync, wait for their
+    commands to complete on insertion instead and return a fence that is
+    always signaled. *)
+module Fence :
+  sig
+    type t
+
+    (** Inserts a fence in the command stream of the current context and
+        flushes it, so that other contexts may wait on it. *)
+    external insert : unit -> t = "caml_glfwFenceInsert"
+
+    (** Makes the current context wait on the GPU for the fence to be
+        signaled before executing further commands. Returns immediately. *)
+    external wait : t -> unit = "caml_glfwFenceWait"
+
+    (** Blocks the calling thread until the fence is signaled or timeout
+        seconds have elapsed, and returns whether it was signaled. A zero
+        or nan timeout polls the fence and infinity waits without limit. The
+        OCaml runtime lock is released while waiting. *)
+    external clientWait : t -> timeout:(float [@unboxed]) -> bool
+      = "caml_glfwFenceClientWait_byte" "caml_glfwFenceClientWait"
+
+    (** Deletes the fence. It must not be used afterwards. *)
+    external delete : t -> unit = "caml_glfwFenceDelete"
+  end
+
+(** Hidden windows whose contexts share the objects of a main context, for
+    worker threads to upload textures and buffers while the main context
+    renders.
+
+    A worker acquires a context, making it current on its thread, issues
+    its uploads and releases it. The fence returned on release is to be
+    waited on by the rendering context before using the uploaded objects
+    and deleted afterwards. acquire and release may be called from any
+    thread and never block. *)
+module ContextPool :
+  sig
+    type t
+
+    (** Creates count invisible windows sharing the context of share. The
+        Visible window hint is set back to its default value afterwards.
+        Like createWindow, it may only be called from the main thread. *)
+    val create : share:window -> count:int -> t
+
+    (** Destroys the windows of the pool, which must all have been
+        released. May only be called from the main thread. *)
+    val destroy : t -> unit
+
+    (** Takes a context from the pool and makes it current on the calling
+        thread, or returns None if all of them are in use. *)
+    val acquire : t -> window option
+
+    (** Inserts a fence after the commands issued by the context, detaches it
+        from the calling thread and returns it to the pool. *)
+    val release : t -> window -> Fence.t
+  end
+
+(** Integration with external event loops such as Lwt or Eio.
+
+    Instead of blocking in waitEvents, a scheduler can wait for the
+    descriptors returned by fds to become readable, together with its own,
+    then call pollEvents to process the pending events:
+{[
+      let fds = GLFW.EventLoop.fds () in
+      while not (GLFW.windowShouldClose ~window) do
+        let timeout = if GLFW.EventLoop.prepareWait () then 0. else -1. in
+        let ready, _, _ = Unix.select (fds @ sockets) [] [] timeout in
+        GLFW.pollEvents ();
+        handle_sockets ready
+      done
+]}
+    The display descriptor alone does not tell whether events are pending:
+    Xlib and libwayland may read them from the connection during any call,
+    such as swapBuffers, and queue them. prepareWait must therefore be
+    called right before every wait, which must not block when it returns
+    true. *)
+module EventLoop :
+  sig
+    (** Returns the descriptor of the connection to the display server on
+        X11 and Wayland, or None on other platforms. It becomes readable when
+        events are received. The function giving it is looked up at run
+        time in the libraries already loaded by GLFW.
+        @raise Failure if GLFW is connected to a display but that function
+        cannot be found, for example without libdl. *)
+    external displayFd : unit -> Unix.file_descr option
+      = "caml_glfwGetDisplayFd"
+
+    (** Returns a descriptor becoming readable whenever postEmptyEvent is
+        called, including by MainThread.post, until the next pollEvents. It is
+        created on the first call and kept open afterwards.
+        @raise Failure on Windows or if it can not be created. *)
+    external wakeupFd : unit -> Unix.file_descr = "caml_glfwGetWakeupFd"
+
+    (** Flushes the requests to the display server and returns whether
+        events were already received and are waiting to be processed by
+        pollEvents. On Wayland, events queued on the client side are
+        dispatched, so that closures may be called. Always returns false on
+        platforms other than X11 and Wayland.
+        @raise Failure if a function of the display library cannot be
+        found, as with displayFd. *)
+    external prepareWait : unit -> bool = "caml_glfwEventLoopPrepareWait"
+
+    (** Returns the wake-up descriptor and the display one if available. *)
+    val fds : unit -> Unix.file_descr list
+  end
+
+(** Snapshot of the connected monitors and their video modes.
+
+    The snapshot is taken on first use and kept until GLFW reports a
+    monitor being connected or disconnected, or is initialized again, so
+    that querying it every frame allocates nothing. Changes not reported by
+    GLFW, such as a new video mode set by a full screen window or a moved
+    taskbar, require calling refresh. *)
+module MonitorRegistry :
+  sig
+    (** Read-only array. *)
+    type 'a view
+
+    val length : 'a view -> int
+
+    (** @raise Invalid_argument if the index is out of bounds. *)
+    val get : 'a view -> int -> 'a
+
+    val toList : 'a view -> 'a list
+
+    type entry = {
+        monitor : monitor;
+        name : string;
+        position : int * int;
+        workarea : int * int * int * int;
+        physical_size : int * int;
+        content_scale : float * float;
+        current_mode : video_mode;
+        (** Sorted by color depth, then resolution, then refresh rate. *)
+        modes : video_mode view;
+      }
+
+    (** Returns the connected monitors, the primary one first. *)
+    val monitors : unit -> entry view
+
+    (** Returns the primary monitor, if any. *)
+    val primary : unit -> entry option
+
+    val find : monitor -> entry option
+
+    (** Takes a new snapshot and returns the monitors. *)
+    val refresh : unit -> entry view
+
+    (** Returns the video mode of the monitor closest to the requested one,
+        ranked like setWindowMonitor does: color depth first, then
+        resolution, then refresh rate, the highest one if none is
+        requested. Unlike GLFW, which compares each channel to its hint,
+        the color depth is compared on the sum of all channels, 24 by
+        default. The closest depths and the modes of the requested
+        resolution are found by binary search.
+        @raise Invalid_argument if the monitor has no video mode. *)
+    val bestMode :
+      entry -> width:int -> height:int -> ?refresh_rate:int -> ?bits:int
+      -> unit -> video_mode
+  end
+
+(** Clipboard transfers through Bigarrays, avoiding copies to the OCaml heap
+    for large contents. Like the clipboard functions above, these may only
+    be called from the main thread. *)
+module Clipboard :
+  sig
+    type buffer =
+      (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+    (** Reads the clipboard and returns the length in bytes of its contents,
+        which are kept until the next clipboard function call so that blit
+        can copy them to a buffer of sufficient size, at once or in chunks. *)
+    external fetch : unit -> int = "caml_glfwClipboardFetch"
+
+    (** Copies len bytes of the fetched contents, starting at src_pos, to
+        dst at dst_pos.
+        @raise Invalid_argument if nothing was fetched since the last
+        clipboard function call or if a range is out of bounds. *)
+    external blit :
+      src_pos:int -> dst:buffer -> dst_pos:int -> len:int -> unit
+      = "caml_glfwClipboardBlit"
+
+    (** Sets the clipboard to the first len bytes of the buffer, all of them
+        by default. They are passed to GLFW without copy if the buffer has a
+        NUL character right after them.
+        @raise Invalid_argument if len exceeds the size of the buffer. *)
+    val set : ?len:int -> buffer -> unit
+  end
+
+(** Offscreen rendering with asynchronous readback.
+
+    Frames rendered to the current read framebuffer, such as the default
+    framebuffer of a hidden or OSMesa window, are read into a ring of pixel
+    buffer objects and handed to a callback once the GPU has completed the
+    read, a few frames later, instead of stalling the rendering thread on
+    every glReadPixels. The callback always receives the same buffer, which
+    holds the last frame as RGBA bytes, rows from bottom to top, and is
+    overwritten by the next one. Contexts without pixel buffer objects,
+    below OpenGL 2.1 or OpenGL ES 3.0 and lacking ARB_pixel_buffer_object,
+    read synchronously instead. The pixel pack parameters and buffer
+    binding of the application are left untouched.
+
+    All functions but createWindow require the context current on the
+    calling thread when the reader was created and raise NoCurrentContext
+    otherwise. *)
+module Offscreen :
+  sig
+    type frame =
+      (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+    type t
+
+    (** Creates an invisible window to render to, with an OSMesa context if
+        osmesa is true. Rendering without a display requires a GLFW built for
+        it, with its null platform or with OSMesa support on a platform that
+        can be initialized without a display. The window hints it changes
+        are set back to their default values afterwards. *)
+    val createWindow : ?osmesa:bool -> width:int -> height:int -> unit
+                       -> window
+
+    (** Creates a reader of width by height frames with a ring of buffers
+        buffers, 2 by default, which on_frame is called with once each frame
+        is ready.
+        @raise Invalid_argument if the size is not positive or buffers is
+        not between 1 and 8. *)
+    val create : ?buffers:int -> width:int -> height:int -> (frame -> unit)
+                 -> t
+
+    (** Deletes the buffers of the reader. Frames still pending are
+        dropped. *)
+    val destroy : t -> unit
+
+    (** Delivers the frames that are ready, then starts reading the current
+        read framebuffer. If every buffer is pending, waits for the oldest
+        frame and delivers it first. *)
+    val read : t -> unit
+
+    (** Delivers the frames that are ready without waiting. *)
+    val poll : t -> unit
+
+    (** Waits for and delivers every pending frame. *)
+    val finish : t -> unit
+
+    (** Returns the number of frames being read. *)
+    val pending : t -> int
+  end
+
+(** Instrumentation of the stubs.
+
+    When enabled, the stubs that call into GLFW for a significant time, such
+    as pollEvents, swapBuffers or createWindow, and the dispatch of every
+    callback type to its closures count their calls and time them with the
+    GLFW timer. Disabled probes cost a single test, and none at all if the
+    stubs are compiled with -DML_NO_PROBES, in which case enable does
+    nothing. The time of a callback dispatch is included in the time of the
+    function that triggered it, usually pollEvents. *)
+module Probes :
+  sig
+    (** A count x (2 + buckets) array. Row i holds the calls of probe i, its
+        total time in nanoseconds and its histogram: column bucket b counts
+        the calls that took less than bucketLimit b and at least
+        bucketLimit (b - 1), the last bucket holding all longer ones. *)
+    type snapshot =
+      (int64, Bigarray.int64_elt, Bigarray.c_layout) Bigarray.Array2.t
+
+    external enable : bool -> unit = "caml_glfwProbesEnable" [@@noalloc]
+    external enabled : unit -> bool = "caml_glfwProbesEnabled" [@@noalloc]
+
+    (** Clears all counters. *)
+    external reset : unit -> unit = "caml_glfwProbesReset" [@@noalloc]
+
+    (** Returns a copy of the counters. *)
+    external snapshot : unit -> snapshot = "caml_glfwProbesSnapshot"
+
+    (** Names of the probes, indexed like the rows of a snapshot: the OCaml
+        name of instrumented functions and the callback type of the
+        others, such as key or cursor_pos. *)
+    val names : string array
+    val count : int
+    val isCallback : int -> bool
+
+    (** Column indices in a snapshot. *)
+    val calls : int
+    val time : int
+    val buckets : int
+    val bucket : int -> int
+
+    (** Returns the upper bound in seconds of the durations counted by a
+        bucket, from 2 ns for the first to about 4.3 s. *)
+    val bucketLimit : int -> float
+
+    (** Formats the probes that were called into a table of calls, total
+        and mean time and the medians and 99th percentiles estimated from
+        their histograms. *)
+    val report : unit -> string
+  end
+
+(** Tracing of the probes in the Chrome trace event format, readable by
+    chrome://tracing and Perfetto.
+
+    While tracing, every call timed by a probe, such as pollEvents,
+    waitEventsTimeout, swapBuffers or the dispatch of a key or cursor_pos
+    callback, is pushed as a span stamped with the GLFW timer to an
+    in-memory ring of 65536 spans. Pushing never blocks: spans pushed while
+    the ring is full are dropped. flush writes the spans in the ring to the
+    trace file and should be called regularly, for example once per frame
+    or from a thread of its own. Tracing is independent from the counters
+    of the Probes module. *)
+module Tracing :
+  sig
+    (** Starts tracing to the file at path, truncating it. GLFW must be
+        initialized.
+        @raise Sys_error if the file cannot be opened.
+        @raise Invalid_argument if tracing is already in progress.
+        @raise Failure if the stubs were compiled with -DML_NO_PROBES. *)
+    external start : path:string -> unit = "caml_glfwTracingStart"
+
+    (** Writes the spans in the ring to the trace file. The runtime lock is
+        released while writing. Does nothing if tracing is not in progress
+        or if another thread is flushing. *)
+    external flush : unit -> unit = "caml_glfwTracingFlush"
+
+    (** Stops tracing, writes the remaining spans and closes the file. Does
+        nothing if tracing is not in progress.
+        @raise Failure if the file could not be written. *)
+    external stop : unit -> unit = "caml_glfwTracingStop"
+
+    external tracing : unit -> bool = "caml_glfwTracingTracing" [@@noalloc]
+
+    (** Returns the number of spans dropped since tracing started, which is
+        also written to the trace file by stop. *)
+    external dropped : unit -> int = "caml_glfwTracingDropped" [@@noalloc]
+  end
+
+(** Recording of the input events delivered to the application into a
+    compact binary log, which can be replayed with the Replayer module.
+
+    Events are recorded as they reach the closures or the event queue, after
+    coalescing, with the time elapsed since the previous one. Windows are
+    identified by their creation order, counting every window created by
+    the program, destroyed or not, and monitors by their index in
+    getMonitors. *)
+module Recorder :
+  sig
+    (** Starts recording to the file at path, truncating it.
+        @raise Sys_error if the file cannot be opened.
+        @raise Invalid_argument if a recording is already in progress. *)
+    external start : path:string -> unit = "caml_glfwRecorderStart"
+
+    (** Stops recording and closes the file. Does nothing if no recording is
+        in progress.
+        @raise Failure if the file could not be written. *)
+    external stop : unit -> unit = "caml_glfwRecorderStop"
+
+    external recording : unit -> bool = "caml_glfwRecorderRecording"
+      [@@noalloc]
+  end
+
+(** Replay of a recording made by the Recorder module. Each event is
+    delivered the way GLFW would deliver it to the window, to its closures
+    or to the event queue, so windows must be created in the same order as
+    when recording, destroyed ones included, and have their closures set
+    before replaying. Events of windows that were destroyed are skipped and
+    replayed events are not recorded again. *)
+module Replayer :
+  sig
+    type t [@@immediate]
+
+    (** Loads the recording at path.
+        @raise Sys_error if the file cannot be read.
+        @raise Failure if it is not a recording. *)
+    external create : path:string -> t = "caml_glfwReplayerCreate"
+
+    external destroy : t -> unit = "caml_glfwReplayerDestroy" [@@noalloc]
+
+    (** Delivers the next event regardless of its time and returns whether
+        events remain.
+        @raise Failure if the recording is corrupted. *)
+    val step : t -> bool
+
+    (** Delivers every event due at the current time, measured from the
+        first call, and returns whether events remain. Call it in place of or
+        along with pollEvents to replay in real time.
+        @raise Failure if the recording is corrupted. *)
+    val advance : t -> bool
+
+    (** Delivers all remaining events at once. *)
+    val run : t -> unit
+  end
 
 external window_magic : window -> window = "caml_window_magic"
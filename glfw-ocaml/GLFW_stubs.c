@@ -1,12 +1,23 @@
 #include <GLFW/glfw3.h>
+#include <stddef.h>
 #include <string.h>
 #include <caml/mlvalues.h>
 #include <caml/alloc.h>
 #include <caml/memory.h>
 #include <caml/fail.h>
 #include <caml/callback.h>
+#include <caml/signals.h>
 #include <caml/bigarray.h>
 #include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#ifndef _WIN32
+# include <unistd.h>
+# include <fcntl.h>
+#endif
+#ifdef __linux__
+# include <sys/eventfd.h>
+#endif
 
 #ifdef CAMLunused_start /* Introduced in OCaml 4.03 */
 # define CAMLvoid CAMLunused_start value unit CAMLunused_end
@@ -29,6 +40,10 @@ static value caml_alloc_some(value v)
 }
 #endif
 
+#ifndef CAMLdrop /* Introduced in OCaml 4.10 */
+# define CAMLdrop caml_local_roots = caml__frame
+#endif
+
 /* The use of pointers outside the OCaml heap inside OCaml code was
    deprecated in version 4.11. As per the OCaml 4.12.0 manual in
    section 18.2.3, provided we check such pointers never have their
@@ -96,43 +111,206 @@ struct ml_window_callbacks
     value cursor_enter;
     value scroll;
     value drop;
+    value key_bits;
+    value character_mods_bits;
+    value mouse_button_bits;
+    value drop_paths;
+    value queued;
 };
 
 #define ML_WINDOW_CALLBACKS_WOSIZE \
     (sizeof(struct ml_window_callbacks) / sizeof(value))
 
-#define CAML_WINDOW_SETTER_STUB(glfw_setter, name)                      \
-    CAMLprim value caml_##glfw_setter(value ml_window, value new_closure) \
+/* The callbacks of every window live in a single table registered as one
+   generational global root, ML_WINDOW_CALLBACKS_WOSIZE fields per window.
+   The GLFW user pointer of a window holds its index in the table and the
+   indices of destroyed windows are reused. The table may be moved by the GC
+   or reallocated, so pointers into it must be fetched again after anything
+   that may allocate, including calling a closure. */
+static value window_table = Val_unit;
+static uintnat window_table_capacity = 0;
+static uintnat window_table_used = 0;
+static uintnat* free_window_ids = NULL;
+static uintnat free_window_count = 0;
+
+/* State of a window kept on the C side, indexed like the table. Windows
+   with coalesced events waiting to be delivered are listed in
+   pending_window_ids, at most once thanks to the listed flag, which is
+   kept when an index is reused. */
+struct ml_window_state
+{
+    GLFWwindow* window;
+    uintnat serial;
+    int coalescing;
+    int listed;
+    int cursor_pos_pending;
+    int scroll_pending;
+    double cursor_x, cursor_y;
+    double scroll_x, scroll_y;
+    struct animated_cursor* animated_cursor;
+};
+
+static struct ml_window_state* window_states = NULL;
+static uintnat animated_window_count = 0;
+static uintnat* pending_window_ids = NULL;
+static uintnat pending_window_count = 0;
+/* Counts the windows created so far, giving each a serial number that,
+   unlike its index, is never reused. */
+static uintnat window_serial = 0;
+
+static inline uintnat window_id(GLFWwindow* window)
+{
+    return (uintnat)glfwGetWindowUserPointer(window);
+}
+
+static inline struct ml_window_callbacks* window_callbacks(GLFWwindow* window)
+{
+    return (struct ml_window_callbacks*)&Field(
+        window_table, window_id(window) * ML_WINDOW_CALLBACKS_WOSIZE);
+}
+
+static int window_table_grow(void)
+{
+    CAMLparam0();
+    CAMLlocal1(table);
+    uintnat capacity =
+        window_table_capacity == 0 ? 16 : 2 * window_table_capacity;
+    uintnat* ids = realloc(free_window_ids, capacity * sizeof(*ids));
+    mlsize_t used = window_table_capacity * ML_WINDOW_CALLBACKS_WOSIZE;
+
+    if (ids == NULL)
+        CAMLreturnT(int, 0);
+    free_window_ids = ids;
+    ids = realloc(pending_window_ids, capacity * sizeof(*ids));
+    if (ids == NULL)
+        CAMLreturnT(int, 0);
+    pending_window_ids = ids;
+    struct ml_window_state* states =
+        realloc(window_states, capacity * sizeof(*states));
+    if (states == NULL)
+        CAMLreturnT(int, 0);
+    window_states = states;
+    for (uintnat i = window_table_capacity; i < capacity; ++i)
+        window_states[i].listed = 0;
+    table = caml_alloc(capacity * ML_WINDOW_CALLBACKS_WOSIZE, 0);
+    for (mlsize_t i = 0; i < used; ++i)
+        caml_modify(&Field(table, i), Field(window_table, i));
+    caml_modify_generational_global_root(&window_table, table);
+    window_table_capacity = capacity;
+    CAMLreturnT(int, 1);
+}
+
+/* Gives a window an empty set of callbacks. Returns false when out of
+   memory. */
+static int ml_window_register(GLFWwindow* window)
+{
+    uintnat id;
+
+    if (free_window_count > 0)
+        id = free_window_ids[--free_window_count];
+    else if (window_table_used < window_table_capacity || window_table_grow())
+        id = window_table_used++;
+    else
+        return 0;
+    window_states[id].window = window;
+    window_states[id].serial = window_serial++;
+    window_states[id].coalescing = 0;
+    window_states[id].cursor_pos_pending = 0;
+    window_states[id].scroll_pending = 0;
+    window_states[id].animated_cursor = NULL;
+    glfwSetWindowUserPointer(window, (void*)id);
+    return 1;
+}
+
+static void ml_window_release(uintnat id)
+{
+    value* fields = &Field(window_table, id * ML_WINDOW_CALLBACKS_WOSIZE);
+
+    for (unsigned int i = 0; i < ML_WINDOW_CALLBACKS_WOSIZE; ++i)
+        caml_modify(&fields[i], Val_unit);
+    window_states[id].cursor_pos_pending = 0;
+    window_states[id].scroll_pending = 0;
+    if (window_states[id].animated_cursor != NULL)
+    {
+        window_states[id].animated_cursor = NULL;
+        --animated_window_count;
+    }
+    window_states[id].window = NULL;
+    free_window_ids[free_window_count++] = id;
+}
+
+/* Tells GLFW which stub to call for a window callback: the event queue
+   recorder if the window is attached to the event queue, the closure
+   dispatcher if a closure is set, or none. */
+#define CAML_WINDOW_INSTALLER(glfw_setter, name)                        \
+    static void install_##name(                                         \
+        GLFWwindow* window, struct ml_window_callbacks* callbacks)      \
+    {                                                                   \
+        if (Bool_val(callbacks->queued))                                \
+            glfw_setter(window, name##_queue_stub);                     \
+        else if (callbacks->name != Val_unit)                           \
+            glfw_setter(window, name##_callback_stub);                  \
+        else                                                            \
+            glfw_setter(window, NULL);                                  \
+    }
+
+/* Same as above for callbacks that can be set both with modifiers as a list
+   and as a bitset. A single stub dispatches to both closures. */
+#define CAML_WINDOW_SHARED_INSTALLER(glfw_setter, name)                 \
+    static void install_##name(                                         \
+        GLFWwindow* window, struct ml_window_callbacks* callbacks)      \
+    {                                                                   \
+        if (Bool_val(callbacks->queued))                                \
+            glfw_setter(window, name##_queue_stub);                     \
+        else if (callbacks->name != Val_unit                            \
+                 || callbacks->name##_bits != Val_unit)                 \
+            glfw_setter(window, name##_callback_stub);                  \
+        else                                                            \
+            glfw_setter(window, NULL);                                  \
+    }
+
+/* Same as CAML_WINDOW_INSTALLER for callbacks whose events may be merged
+   until the end of the current pollEvents or waitEvents call. */
+#define CAML_WINDOW_COALESCING_INSTALLER(glfw_setter, name)             \
+    static void install_##name(                                         \
+        GLFWwindow* window, struct ml_window_callbacks* callbacks)      \
+    {                                                                   \
+        if (Bool_val(callbacks->queued))                                \
+            glfw_setter(window, name##_queue_stub);                     \
+        else if (callbacks->name == Val_unit)                           \
+            glfw_setter(window, NULL);                                  \
+        else if (window_states[window_id(window)].coalescing)           \
+            glfw_setter(window, name##_coalesce_stub);                  \
+        else                                                            \
+            glfw_setter(window, name##_callback_stub);                  \
+    }
+
+#define CAML_WINDOW_CALLBACK_SETTER(function, name, install)            \
+    CAMLprim value function(value ml_window, value new_closure)         \
     {                                                                   \
         CAMLparam1(new_closure);                                        \
         CAMLlocal1(previous_closure);                                   \
         GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);          \
         struct ml_window_callbacks* ml_window_callbacks =               \
-            *(struct ml_window_callbacks**)                             \
-            glfwGetWindowUserPointer(window);                           \
+            window_callbacks(window);                                   \
                                                                         \
         raise_if_error();                                               \
         if (ml_window_callbacks->name == Val_unit)                      \
             previous_closure = Val_none;                                \
         else                                                            \
             previous_closure = caml_alloc_some(ml_window_callbacks->name); \
+        ml_window_callbacks = window_callbacks(window);                 \
         if (Is_none(new_closure))                                       \
-        {                                                               \
-            if (ml_window_callbacks->name != Val_unit)                  \
-            {                                                           \
-                glfw_setter(window, NULL);                              \
-                ml_window_callbacks->name = Val_unit;                   \
-            }                                                           \
-        }                                                               \
+            caml_modify(&ml_window_callbacks->name, Val_unit);          \
         else                                                            \
-        {                                                               \
-            if (ml_window_callbacks->name == Val_unit)                  \
-                glfw_setter(window, name##_callback_stub);              \
             caml_modify(&ml_window_callbacks->name, Some_val(new_closure)); \
-        }                                                               \
+        install(window, ml_window_callbacks);                           \
         CAMLreturn(previous_closure);                                   \
     }
 
+#define CAML_WINDOW_SETTER_STUB(glfw_setter, name)                      \
+    CAML_WINDOW_CALLBACK_SETTER(caml_##glfw_setter, name, install_##name)
+
 enum value_type
 {
     Int,
@@ -252,68 +430,666 @@ static inline value caml_copy_vidmode(const GLFWvidmode* vidmode)
     return v;
 }
 
-static value error_tag = Val_unit;
-static value error_arg = Val_unit;
+#if defined(_MSC_VER)
+# define ML_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+# define ML_THREAD_LOCAL __thread
+#else
+# define ML_THREAD_LOCAL _Thread_local
+#endif
+
+/* GLFW may report errors while the runtime lock is released (see
+   caml_glfwWaitEvents), so the error callback must not touch the OCaml heap.
+   The error is kept on the C side until raise_if_error turns it into an
+   exception. GLFW reports errors on the thread that caused them, so keeping
+   them thread-local prevents threads and domains calling GLFW concurrently
+   from raising each other's errors. */
+static ML_THREAD_LOCAL int error_code = GLFW_NO_ERROR;
+static ML_THREAD_LOCAL char error_description[1024];
 
 static void error_callback(int error, const char* description)
 {
-    switch (error)
+    error_code = error;
+    strncpy(error_description, description, sizeof(error_description) - 1);
+    error_description[sizeof(error_description) - 1] = '\0';
+}
+
+/* Exceptions matching the GLFW error codes, from GLFW_NOT_INITIALIZED to
+   GLFW_NO_WINDOW_CONTEXT, resolved once by init_stub. */
+static const char* const error_exception_names[] = {
+    "GLFW.NotInitialized", "GLFW.NoCurrentContext", "GLFW.InvalidEnum",
+    "GLFW.InvalidValue", "GLFW.OutOfMemory", "GLFW.ApiUnavailable",
+    "GLFW.VersionUnavailable", "GLFW.PlatformError",
+    "GLFW.FormatUnavailable", "GLFW.NoWindowContext"
+};
+
+#define ERROR_COUNT \
+    (sizeof(error_exception_names) / sizeof(*error_exception_names))
+
+static const value* error_exceptions[ERROR_COUNT];
+
+/* Position of the error in the Error.t type, unknown errors being ignored. */
+static inline int ml_error(int error)
+{
+    if (error < GLFW_NOT_INITIALIZED
+        || error >= GLFW_NOT_INITIALIZED + (int)ERROR_COUNT)
+        return 0;
+    return error - GLFW_NOT_INITIALIZED + 1;
+}
+
+static inline void raise_if_error(void)
+{
+    int error;
+
+    if (error_code == GLFW_NO_ERROR)
+        return;
+    error = ml_error(error_code);
+    error_code = GLFW_NO_ERROR;
+    if (error != 0)
+        caml_raise_with_string(*error_exceptions[error - 1], error_description);
+}
+
+/* Exported for the stubs generated by gen_gl.ml. */
+void caml_glfw_raise_if_error(void)
+{
+    raise_if_error();
+}
+
+CAMLprim value caml_glfwGetError(CAMLvoid)
+{
+    int error = ml_error(error_code);
+
+    error_code = GLFW_NO_ERROR;
+    return Val_int(error);
+}
+
+CAMLprim value caml_glfwGetErrorDescription(CAMLvoid)
+{
+    return caml_copy_string(error_description);
+}
+
+/* Checked stubs built from their Unchecked counterpart, which leaves errors
+   pending and must return an immediate value. */
+#define CAML_CHECKED_STUB1(name)                                        \
+    CAMLprim value caml_glfw##name(value a)                             \
+    {                                                                   \
+        value ret = caml_glfwUnchecked##name(a);                        \
+        raise_if_error();                                               \
+        return ret;                                                     \
+    }
+
+#define CAML_CHECKED_STUB2(name)                                        \
+    CAMLprim value caml_glfw##name(value a, value b)                    \
+    {                                                                   \
+        value ret = caml_glfwUnchecked##name(a, b);                     \
+        raise_if_error();                                               \
+        return ret;                                                     \
+    }
+
+#define CAML_CHECKED_STUB3(name)                                        \
+    CAMLprim value caml_glfw##name(value a, value b, value c)           \
+    {                                                                   \
+        value ret = caml_glfwUnchecked##name(a, b, c);                  \
+        raise_if_error();                                               \
+        return ret;                                                     \
+    }
+
+/* Set while a stub waits for events outside of the runtime lock. Only the
+   glfwWaitEvents* stubs set it; these must be called from the main thread,
+   which is also the only thread GLFW invokes event callbacks on. */
+static int runtime_released = 0;
+
+/* First exception raised by a callback while the runtime lock was released.
+   It cannot be propagated through GLFW so it is raised once the blocking stub
+   has returned. */
+static value pending_exception = Val_unit;
+
+static inline void release_runtime(void)
+{
+    runtime_released = 1;
+    caml_enter_blocking_section();
+}
+
+static inline void acquire_runtime(void)
+{
+    caml_leave_blocking_section();
+    runtime_released = 0;
+}
+
+static inline void raise_if_callback_failed(void)
+{
+    value exn = pending_exception;
+
+    if (exn != Val_unit)
     {
-    case GLFW_NOT_INITIALIZED:
-        error_tag = *caml_named_value("GLFW.NotInitialized");
-        break;
-    case GLFW_NO_CURRENT_CONTEXT:
-        error_tag = *caml_named_value("GLFW.NoCurrentContext");
-        break;
-    case GLFW_INVALID_ENUM:
-        error_tag = *caml_named_value("GLFW.InvalidEnum");
-        break;
-    case GLFW_INVALID_VALUE:
-        error_tag = *caml_named_value("GLFW.InvalidValue");
-        break;
-    case GLFW_OUT_OF_MEMORY:
-        error_tag = *caml_named_value("GLFW.OutOfMemory");
-        break;
-    case GLFW_API_UNAVAILABLE:
-        error_tag = *caml_named_value("GLFW.ApiUnavailable");
-        break;
-    case GLFW_VERSION_UNAVAILABLE:
-        error_tag = *caml_named_value("GLFW.VersionUnavailable");
-        break;
-    case GLFW_PLATFORM_ERROR:
-        error_tag = *caml_named_value("GLFW.PlatformError");
-        break;
-    case GLFW_FORMAT_UNAVAILABLE:
-        error_tag = *caml_named_value("GLFW.FormatUnavailable");
-        break;
-    case GLFW_NO_WINDOW_CONTEXT:
-        error_tag = *caml_named_value("GLFW.NoWindowContext");
+        caml_modify_generational_global_root(&pending_exception, Val_unit);
+        caml_raise(exn);
     }
-    error_arg = caml_copy_string(description);
 }
 
-static inline void raise_if_error(void)
+/* Raises Sys_error with the message of errno, prefixed by path. */
+static void raise_sys_error(value path)
+{
+    CAMLparam1(path);
+    CAMLlocal1(message);
+    const char* error = strerror(errno);
+    mlsize_t length = caml_string_length(path);
+
+    message = caml_alloc_string(length + 2 + strlen(error));
+    memcpy(Bytes_val(message), String_val(path), length);
+    memcpy(Bytes_val(message) + length, ": ", 2);
+    memcpy(Bytes_val(message) + length + 2, error, strlen(error));
+    CAMLnoreturn;
+    caml_raise_sys_error(message);
+}
+
+/* Instrumentation probes. Each probe counts the calls to a stub or to the
+   closures of a callback type, sums their duration in GLFW timer ticks and
+   sorts them into a histogram of power-of-two nanosecond buckets. Probes
+   are disabled by default and only cost a test of probes_enabled then, or
+   nothing at all when compiled with ML_NO_PROBES. The counters are not
+   atomic: calls made concurrently from several threads, which only
+   swapBuffers and makeContextCurrent allow, may be lost. */
+#define ML_PROBES(X)                                                    \
+    X(CreateWindow, "createWindow")                                     \
+    X(DestroyWindow, "destroyWindow")                                   \
+    X(SetWindowTitle, "setWindowTitle")                                 \
+    X(PollEvents, "pollEvents")                                         \
+    X(WaitEvents, "waitEvents")                                         \
+    X(WaitEventsTimeout, "waitEventsTimeout")                           \
+    X(PostEmptyEvent, "postEmptyEvent")                                 \
+    X(MakeContextCurrent, "makeContextCurrent")                         \
+    X(SwapBuffers, "swapBuffers")                                       \
+    X(SwapInterval, "swapInterval")                                     \
+    X(GetMonitors, "getMonitors")                                       \
+    X(GetVideoModes, "getVideoModes")                                   \
+    X(GetJoystickAxes, "getJoystickAxes")                               \
+    X(GetGamepadState, "getGamepadState")                               \
+    X(GetClipboardString, "getClipboardString")                         \
+    X(SetClipboardString, "setClipboardString")                         \
+    X(Monitor, "monitor")                                               \
+    X(Joystick, "joystick")                                             \
+    X(WindowPos, "window_pos")                                          \
+    X(WindowSize, "window_size")                                        \
+    X(WindowClose, "window_close")                                      \
+    X(WindowRefresh, "window_refresh")                                  \
+    X(WindowFocus, "window_focus")                                      \
+    X(WindowIconify, "window_iconify")                                  \
+    X(WindowMaximize, "window_maximize")                                \
+    X(FramebufferSize, "framebuffer_size")                              \
+    X(WindowContentScale, "window_content_scale")                       \
+    X(Key, "key")                                                       \
+    X(Character, "character")                                           \
+    X(CharacterMods, "character_mods")                                  \
+    X(MouseButton, "mouse_button")                                      \
+    X(CursorPos, "cursor_pos")                                          \
+    X(CursorEnter, "cursor_enter")                                      \
+    X(Scroll, "scroll")                                                 \
+    X(Drop, "drop")
+
+#define ML_PROBE_ID(id, name) Probe##id,
+#define ML_PROBE_NAME(id, name) name,
+
+enum ml_probe { ML_PROBES(ML_PROBE_ID) ProbeCount };
+
+/* Probes from ProbeMonitor on time callback dispatches. */
+#define PROBE_FIRST_CALLBACK ProbeMonitor
+#define PROBE_BUCKETS 32
+#define PROBE_FIELDS (2 + PROBE_BUCKETS)
+
+static const char* probe_names[] = { ML_PROBES(ML_PROBE_NAME) NULL };
+
+/* Probes are enabled for counting, tracing or both. */
+#define PROBE_COUNT 1
+#define PROBE_TRACE 2
+
+#ifdef ML_NO_PROBES
+# define probes_enabled 0
+#else
+static int probes_enabled = 0;
+#endif
+static uint64_t probe_counters[ProbeCount][PROBE_FIELDS];
+static double probe_tick_ns = 0.;
+
+/* Returns the current timer value, or 0 if probes are disabled. */
+static inline uint64_t probe_begin(void)
+{
+    return probes_enabled ? glfwGetTimerValue() : 0;
+}
+
+static void probe_count(enum ml_probe probe, uint64_t ticks)
+{
+    uint64_t* counters = probe_counters[probe];
+    uint64_t ns;
+    int bucket = 0;
+
+    if (probe_tick_ns == 0.)
+        probe_tick_ns = 1e9 / (double)glfwGetTimerFrequency();
+    ns = (uint64_t)((double)ticks * probe_tick_ns);
+    while (bucket < PROBE_BUCKETS - 1 && ns >> (bucket + 1) != 0)
+        ++bucket;
+    ++counters[0];
+    counters[1] += ticks;
+    ++counters[2 + bucket];
+}
+
+/* Trace of the probes. Each call timed by a probe while tracing is pushed to
+   a bounded ring as a span, and Tracing.flush writes the spans to the trace
+   file in the Chrome trace event format. Producers, which may run on any
+   thread, reserve their slot with a compare-and-swap on trace_head and
+   publish it through its sequence number, so that pushing a span never
+   blocks; spans pushed while the ring is full are dropped and counted. */
+#if defined(_MSC_VER)
+# include <intrin.h>
+
+static inline uint64_t ml_atomic_load(volatile uint64_t* p)
+{
+    return (uint64_t)_InterlockedOr64((volatile __int64*)p, 0);
+}
+
+static inline void ml_atomic_store(volatile uint64_t* p, uint64_t v)
+{
+    _InterlockedExchange64((volatile __int64*)p, (__int64)v);
+}
+
+static inline int ml_atomic_cas(volatile uint64_t* p, uint64_t expected,
+                                uint64_t desired)
+{
+    return _InterlockedCompareExchange64((volatile __int64*)p,
+                                         (__int64)desired, (__int64)expected)
+        == (__int64)expected;
+}
+
+static inline uint64_t ml_atomic_incr(volatile uint64_t* p)
+{
+    return (uint64_t)_InterlockedIncrement64((volatile __int64*)p);
+}
+#else
+static inline uint64_t ml_atomic_load(volatile uint64_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void ml_atomic_store(volatile uint64_t* p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static inline int ml_atomic_cas(volatile uint64_t* p, uint64_t expected,
+                                uint64_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t ml_atomic_incr(volatile uint64_t* p)
+{
+    return __atomic_add_fetch(p, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+#define TRACE_CAPACITY 65536
+
+struct trace_span
+{
+    volatile uint64_t sequence;
+    uint64_t start;
+    uint64_t end;
+    int probe;
+    int thread;
+};
+
+/* The sequence number of a slot is its position while it is free, the
+   position plus one once a span is published to it, and the position of its
+   next use once the span is consumed. */
+static struct trace_span trace_ring[TRACE_CAPACITY];
+static volatile uint64_t trace_head = 0;
+static uint64_t trace_tail = 0;
+static volatile uint64_t trace_flushing = 0;
+static volatile uint64_t trace_dropped = 0;
+static volatile uint64_t trace_threads = 0;
+static ML_THREAD_LOCAL int trace_thread = 0;
+
+static void trace_push(enum ml_probe probe, uint64_t start, uint64_t end)
+{
+    struct trace_span* span;
+    uint64_t position;
+
+    if (trace_thread == 0)
+        trace_thread = (int)ml_atomic_incr(&trace_threads);
+    for (;;)
+    {
+        position = ml_atomic_load(&trace_head);
+        span = trace_ring + position % TRACE_CAPACITY;
+        if (ml_atomic_load(&span->sequence) != position)
+        {
+            /* Either the ring is full or another producer took the slot. */
+            if (ml_atomic_load(&trace_head) != position)
+                continue;
+            ml_atomic_incr(&trace_dropped);
+            return;
+        }
+        if (ml_atomic_cas(&trace_head, position, position + 1))
+            break;
+    }
+    span->start = start;
+    span->end = end;
+    span->probe = probe;
+    span->thread = trace_thread;
+    ml_atomic_store(&span->sequence, position + 1);
+}
+
+/* Records a call that started at start, as returned by probe_begin. Calls
+   started while probes were disabled are ignored. */
+static inline void probe_end(enum ml_probe probe, uint64_t start)
+{
+    if (probes_enabled && start != 0)
+    {
+        uint64_t end = glfwGetTimerValue();
+
+        if (probes_enabled & PROBE_COUNT)
+            probe_count(probe, end - start);
+        if (probes_enabled & PROBE_TRACE)
+            trace_push(probe, start, end);
+    }
+}
+
+/* Callback dispatches may nest, a closure calling a function that triggers
+   another callback, but only happen on the main thread. Only dispatches
+   entered while probes are enabled are pushed, so the stack is emptied
+   when probes get enabled, dropping those left by enabling or disabling
+   probes from a closure. */
+#ifndef ML_NO_PROBES
+#define PROBE_STACK_DEPTH 16
+
+static struct
+{
+    enum ml_probe probe;
+    uint64_t start;
+} probe_stack[PROBE_STACK_DEPTH];
+static int probe_depth = 0;
+#endif
+
+CAMLprim value caml_glfwProbesEnable(value enable)
+{
+#ifndef ML_NO_PROBES
+    if (Bool_val(enable))
+    {
+        if (!probes_enabled)
+            probe_depth = 0;
+        probes_enabled |= PROBE_COUNT;
+    }
+    else
+        probes_enabled &= ~PROBE_COUNT;
+#endif
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwProbesEnabled(CAMLvoid)
+{
+    return Val_bool(probes_enabled & PROBE_COUNT);
+}
+
+CAMLprim value caml_glfwProbesReset(CAMLvoid)
+{
+    memset(probe_counters, 0, sizeof(probe_counters));
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwProbesNames(CAMLvoid)
+{
+    return caml_copy_string_array(probe_names);
+}
+
+CAMLprim value caml_glfwProbesFirstCallback(CAMLvoid)
+{
+    return Val_int(PROBE_FIRST_CALLBACK);
+}
+
+/* Copies the counters into a fresh ProbeCount x PROBE_FIELDS array, with
+   durations converted to nanoseconds. */
+CAMLprim value caml_glfwProbesSnapshot(CAMLvoid)
+{
+    value snapshot = caml_ba_alloc_dims(CAML_BA_INT64 | CAML_BA_C_LAYOUT, 2,
+                                        NULL, (intnat)ProbeCount,
+                                        (intnat)PROBE_FIELDS);
+    int64_t* data = Caml_ba_data_val(snapshot);
+
+    for (int i = 0; i < ProbeCount; ++i)
+        for (int j = 0; j < PROBE_FIELDS; ++j)
+            data[i * PROBE_FIELDS + j] = j == 1
+                ? (int64_t)((double)probe_counters[i][j] * probe_tick_ns)
+                : (int64_t)probe_counters[i][j];
+    return snapshot;
+}
+
+static FILE* trace_file = NULL;
+static uint64_t trace_base;
+static double trace_tick_us;
+static int trace_written;
+
+/* Consumes the published spans, writing them to the trace file unless
+   discard is true. The caller must hold trace_flushing. */
+static void trace_drain(int discard)
+{
+    for (;; ++trace_tail)
+    {
+        struct trace_span* span = trace_ring + trace_tail % TRACE_CAPACITY;
+
+        if (ml_atomic_load(&span->sequence) != trace_tail + 1)
+            break;
+        /* Spans started before tracing are left out. */
+        if (!discard && span->start >= trace_base)
+            fprintf(trace_file,
+                    "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                    "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                    trace_written++ ? ",\n" : "", probe_names[span->probe],
+                    span->probe >= PROBE_FIRST_CALLBACK ? "callback" : "glfw",
+                    (double)(span->start - trace_base) * trace_tick_us,
+                    (double)(span->end - span->start) * trace_tick_us,
+                    span->thread);
+        ml_atomic_store(&span->sequence, trace_tail + TRACE_CAPACITY);
+    }
+}
+
+static void trace_lock(void)
+{
+    while (!ml_atomic_cas(&trace_flushing, 0, 1))
+        ;
+}
+
+static void trace_unlock(void)
+{
+    ml_atomic_store(&trace_flushing, 0);
+}
+
+CAMLprim value caml_glfwTracingStart(value path)
+{
+    static int ring_ready = 0;
+    uint64_t base;
+    FILE* file;
+
+#ifdef ML_NO_PROBES
+    caml_failwith("Tracing.start: probes are compiled out.");
+#endif
+    if (trace_file != NULL)
+        caml_invalid_argument("Tracing.start: already tracing.");
+    base = glfwGetTimerValue();
+    raise_if_error();
+    file = fopen(String_val(path), "w");
+    if (file == NULL)
+        raise_sys_error(path);
+    fputs("{\"traceEvents\":[\n", file);
+    caml_enter_blocking_section();
+    trace_lock();
+    if (!ring_ready)
+    {
+        for (uint64_t i = 0; i < TRACE_CAPACITY; ++i)
+            ml_atomic_store(&trace_ring[i].sequence, i);
+        ring_ready = 1;
+    }
+    trace_drain(1);
+    ml_atomic_store(&trace_dropped, 0);
+    trace_file = file;
+    trace_base = base;
+    trace_tick_us = 1e6 / (double)glfwGetTimerFrequency();
+    trace_written = 0;
+    trace_unlock();
+    caml_leave_blocking_section();
+#ifndef ML_NO_PROBES
+    if (!probes_enabled)
+        probe_depth = 0;
+    probes_enabled |= PROBE_TRACE;
+#endif
+    return Val_unit;
+}
+
+/* Writing does not need the runtime lock, so that a thread can flush the
+   trace while others keep running. A flush that finds another one in
+   progress returns immediately. */
+CAMLprim value caml_glfwTracingFlush(CAMLvoid)
+{
+    if (!ml_atomic_cas(&trace_flushing, 0, 1))
+        return Val_unit;
+    caml_enter_blocking_section();
+    /* Tracing may have stopped since. */
+    if (trace_file != NULL)
+    {
+        trace_drain(0);
+        fflush(trace_file);
+    }
+    trace_unlock();
+    caml_leave_blocking_section();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwTracingStop(CAMLvoid)
+{
+    int failed;
+
+    if (trace_file == NULL)
+        return Val_unit;
+#ifndef ML_NO_PROBES
+    probes_enabled &= ~PROBE_TRACE;
+#endif
+    caml_enter_blocking_section();
+    trace_lock();
+    if (trace_file == NULL)
+    {
+        trace_unlock();
+        caml_leave_blocking_section();
+        return Val_unit;
+    }
+    trace_drain(0);
+    fprintf(trace_file,
+            "\n],\"displayTimeUnit\":\"ms\","
+            "\"otherData\":{\"dropped\":\"%llu\"}}\n",
+            (unsigned long long)ml_atomic_load(&trace_dropped));
+    failed = ferror(trace_file) != 0;
+    failed |= fclose(trace_file) != 0;
+    trace_file = NULL;
+    trace_unlock();
+    caml_leave_blocking_section();
+    if (failed)
+        caml_failwith("Tracing.stop: could not write the trace.");
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwTracingTracing(CAMLvoid)
+{
+    return Val_bool(trace_file != NULL);
+}
+
+CAMLprim value caml_glfwTracingDropped(CAMLvoid)
 {
-    if (error_tag != Val_unit)
+    return Val_long(ml_atomic_load(&trace_dropped));
+}
+
+/* Callback stubs are bracketed by these two functions so that they hold the
+   runtime lock while running OCaml code and their dispatch is timed by the
+   probe of their callback type. callback_enter returns whether the runtime
+   lock was released and clears runtime_released while the closures run, so
+   that dispatches nested in them, such as Replayer.step or GLFW functions
+   triggering callbacks synchronously, neither take the lock again nor
+   release it, and raise their exceptions directly. callback_leave takes
+   that value and the result of a caml_callback*_exn call. */
+static inline int callback_enter(enum ml_probe probe)
+{
+#ifndef ML_NO_PROBES
+    if (probes_enabled)
     {
-        value error_tag_dup = error_tag;
-        value error_arg_dup = error_arg;
+        if (probe_depth < PROBE_STACK_DEPTH)
+        {
+            probe_stack[probe_depth].probe = probe;
+            probe_stack[probe_depth].start = glfwGetTimerValue();
+        }
+        ++probe_depth;
+    }
+#endif
+    if (!runtime_released)
+        return 0;
+    caml_leave_blocking_section();
+    runtime_released = 0;
+    return 1;
+}
 
-        error_tag = Val_unit;
-        error_arg = Val_unit;
-        caml_raise_with_arg(error_tag_dup, error_arg_dup);
+static inline void callback_leave(int released, value result)
+{
+#ifndef ML_NO_PROBES
+    if (probes_enabled && probe_depth > 0
+        && --probe_depth < PROBE_STACK_DEPTH)
+        probe_end(probe_stack[probe_depth].probe,
+                  probe_stack[probe_depth].start);
+#endif
+    if (Is_exception_result(result))
+    {
+        result = Extract_exception(result);
+        if (!released)
+            caml_raise(result);
+        if (pending_exception == Val_unit)
+            caml_modify_generational_global_root(&pending_exception, result);
+    }
+    if (released)
+    {
+        runtime_released = 1;
+        caml_enter_blocking_section();
     }
 }
 
 CAMLprim value init_stub(CAMLvoid)
 {
+    caml_register_generational_global_root(&pending_exception);
+    caml_register_generational_global_root(&window_table);
+    for (unsigned int i = 0; i < ERROR_COUNT; ++i)
+        error_exceptions[i] = caml_named_value(error_exception_names[i]);
     glfwSetErrorCallback(error_callback);
     return Val_unit;
 }
 
+/* Incremented whenever the set of monitors may have changed, so that
+   MonitorRegistry knows when to take a new snapshot. The monitor callback
+   stays installed for that purpose, the OCaml closure being optional. */
+static uintnat monitor_generation = 0;
+
+/* Incremented by destroyWindow, for the GL function tables of the fences
+   and offscreen readers to be resolved again. */
+static volatile uint64_t context_generation = 0;
+
+void monitor_callback_stub(GLFWmonitor* monitor, int event);
+static void record_monitor(GLFWmonitor* monitor, int event);
+
+/* Clipboard contents returned by the last Clipboard.fetch. The string is
+   owned by GLFW and only valid until the next call to glfwGetClipboardString,
+   glfwSetClipboardString or glfwTerminate, after which it is reset. */
+static const char* clipboard_contents = NULL;
+static size_t clipboard_length = 0;
+
 CAMLprim value caml_glfwInit(CAMLvoid)
 {
     glfwInit();
+    ++monitor_generation;
+    raise_if_error();
+    glfwSetMonitorCallback(monitor_callback_stub);
     raise_if_error();
     return Val_unit;
 }
@@ -321,6 +1097,8 @@ CAMLprim value caml_glfwInit(CAMLvoid)
 CAMLprim value caml_glfwTerminate(CAMLvoid)
 {
     glfwTerminate();
+    ++monitor_generation;
+    clipboard_contents = NULL;
     raise_if_error();
     return Val_unit;
 }
@@ -357,8 +1135,10 @@ CAMLprim value caml_glfwGetVersionString(CAMLvoid)
 CAMLprim value caml_glfwGetMonitors(CAMLvoid)
 {
     int monitor_count;
+    uint64_t probe_start = probe_begin();
     GLFWmonitor** monitors = glfwGetMonitors(&monitor_count);
 
+    probe_end(ProbeGetMonitors, probe_start);
     raise_if_error();
     return caml_list_of_pointer_array((void**)monitors, monitor_count);
 }
@@ -430,9 +1210,37 @@ CAMLprim value caml_glfwGetMonitorContentScale(value monitor)
     CAMLreturn(ret);
 }
 
-CAMLprim value caml_glfwGetMonitorName(value monitor)
+CAMLprim double caml_glfwGetMonitorContentScaleX(value monitor)
 {
-    const char* ret = glfwGetMonitorName(Cptr_val(GLFWmonitor*, monitor));
+    float xscale;
+
+    glfwGetMonitorContentScale(Cptr_val(GLFWmonitor*, monitor), &xscale, NULL);
+    raise_if_error();
+    return xscale;
+}
+
+CAMLprim value caml_glfwGetMonitorContentScaleX_byte(value monitor)
+{
+    return caml_copy_double(caml_glfwGetMonitorContentScaleX(monitor));
+}
+
+CAMLprim double caml_glfwGetMonitorContentScaleY(value monitor)
+{
+    float yscale;
+
+    glfwGetMonitorContentScale(Cptr_val(GLFWmonitor*, monitor), NULL, &yscale);
+    raise_if_error();
+    return yscale;
+}
+
+CAMLprim value caml_glfwGetMonitorContentScaleY_byte(value monitor)
+{
+    return caml_copy_double(caml_glfwGetMonitorContentScaleY(monitor));
+}
+
+CAMLprim value caml_glfwGetMonitorName(value monitor)
+{
+    const char* ret = glfwGetMonitorName(Cptr_val(GLFWmonitor*, monitor));
     raise_if_error();
     return caml_copy_string(ret);
 }
@@ -441,20 +1249,58 @@ static value monitor_closure = Val_unit;
 
 void monitor_callback_stub(GLFWmonitor* monitor, int event)
 {
-    caml_callback2(
-        monitor_closure, Val_cptr(monitor), Val_int(event - GLFW_CONNECTED));
+    ++monitor_generation;
+    record_monitor(monitor, event);
+    if (monitor_closure == Val_unit)
+        return;
+    int released = callback_enter(ProbeMonitor);
+    callback_leave(released, caml_callback2_exn(
+        monitor_closure, Val_cptr(monitor), Val_int(event - GLFW_CONNECTED)));
+}
+
+CAMLprim value caml_glfwSetMonitorCallback(value new_closure)
+{
+    CAMLparam1(new_closure);
+    CAMLlocal1(previous_closure);
+
+    if (monitor_closure == Val_unit)
+        previous_closure = Val_none;
+    else
+        previous_closure = caml_alloc_some(monitor_closure);
+    if (Is_none(new_closure))
+    {
+        if (monitor_closure != Val_unit)
+        {
+            caml_remove_generational_global_root(&monitor_closure);
+            monitor_closure = Val_unit;
+        }
+    }
+    else if (monitor_closure == Val_unit)
+    {
+        monitor_closure = Some_val(new_closure);
+        caml_register_generational_global_root(&monitor_closure);
+    }
+    else
+        caml_modify_generational_global_root(
+            &monitor_closure, Some_val(new_closure));
+    CAMLreturn(previous_closure);
 }
 
-CAML_SETTER_STUB(glfwSetMonitorCallback, monitor)
+CAMLprim value caml_glfwMonitorGeneration(CAMLvoid)
+{
+    return Val_long(monitor_generation);
+}
 
 CAMLprim value caml_glfwGetVideoModes(value monitor)
 {
     CAMLparam0();
     CAMLlocal2(ret, vm);
     int videomode_count;
+    uint64_t probe_start = probe_begin();
     const GLFWvidmode* videomodes =
         glfwGetVideoModes(Cptr_val(GLFWmonitor*, monitor), &videomode_count);
 
+    probe_end(ProbeGetVideoModes, probe_start);
     raise_if_error();
     ret = Val_emptylist;
     while (videomode_count > 0)
@@ -475,13 +1321,18 @@ CAMLprim value caml_glfwGetVideoMode(value monitor)
     return caml_copy_vidmode(ret);
 }
 
-CAMLprim value caml_glfwSetGamma(value monitor, value gamma)
+CAMLprim value caml_glfwSetGamma(value monitor, double gamma)
 {
-    glfwSetGamma(Cptr_val(GLFWmonitor*, monitor), Double_val(gamma));
+    glfwSetGamma(Cptr_val(GLFWmonitor*, monitor), gamma);
     raise_if_error();
     return Val_unit;
 }
 
+CAMLprim value caml_glfwSetGamma_byte(value monitor, value gamma)
+{
+    return caml_glfwSetGamma(monitor, Double_val(gamma));
+}
+
 CAMLprim value caml_glfwGetGammaRamp(value monitor)
 {
     CAMLparam0();
@@ -602,33 +1453,27 @@ CAMLprim value caml_window_magic(void* window)
 {
     window = (void*) ((uintptr_t)window >> 1);
 
-    void* user_pointer = malloc(sizeof(value));
-    value callbacks = caml_alloc_small(ML_WINDOW_CALLBACKS_WOSIZE, 0);
-
-    for (unsigned int i = 0; i < ML_WINDOW_CALLBACKS_WOSIZE; ++i)
-        Field(callbacks, i) = Val_unit;
-    *(value*)user_pointer = callbacks;
-    caml_register_generational_global_root(user_pointer);
-    glfwSetWindowUserPointer(window, user_pointer);
+    if (!ml_window_register(window))
+        caml_raise_out_of_memory();
     return Val_cptr(window);
 }
 
 CAMLprim value caml_glfwCreateWindow(
     value width, value height, value title, value mntor, value share, CAMLvoid)
 {
+    uint64_t probe_start = probe_begin();
     GLFWwindow* window = glfwCreateWindow(
         Int_val(width), Int_val(height), String_val(title),
         Is_none(mntor) ? NULL : Cptr_val(GLFWmonitor*, Some_val(mntor)),
         Is_none(share) ? NULL : Cptr_val(GLFWwindow*, Some_val(share)));
-    raise_if_error();
-    void* user_pointer = malloc(sizeof(value));
-    value callbacks = caml_alloc_small(ML_WINDOW_CALLBACKS_WOSIZE, 0);
 
-    for (unsigned int i = 0; i < ML_WINDOW_CALLBACKS_WOSIZE; ++i)
-        Field(callbacks, i) = Val_unit;
-    *(value*)user_pointer = callbacks;
-    caml_register_generational_global_root(user_pointer);
-    glfwSetWindowUserPointer(window, user_pointer);
+    probe_end(ProbeCreateWindow, probe_start);
+    raise_if_error();
+    if (!ml_window_register(window))
+    {
+        glfwDestroyWindow(window);
+        caml_raise_out_of_memory();
+    }
     return Val_cptr(window);
 }
 
@@ -642,23 +1487,27 @@ CAMLprim value caml_glfwCreateWindow_byte(value* val_array, int val_count)
 CAMLprim value caml_glfwDestroyWindow(value ml_window)
 {
     GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
-    void* user_pointer = glfwGetWindowUserPointer(window);
+    uintnat id = window_id(window);
+    uint64_t probe_start;
 
     raise_if_error();
-    caml_remove_generational_global_root(user_pointer);
-    free(user_pointer);
+    ml_window_release(id);
+    probe_start = probe_begin();
     glfwDestroyWindow(window);
+    probe_end(ProbeDestroyWindow, probe_start);
+    ml_atomic_incr(&context_generation);
     raise_if_error();
     return Val_unit;
 }
 
-CAMLprim value caml_glfwWindowShouldClose(value window)
+CAMLprim value caml_glfwUncheckedWindowShouldClose(value window)
 {
     int ret = glfwWindowShouldClose(Cptr_val(GLFWwindow*, window));
-    raise_if_error();
     return Val_bool(ret);
 }
 
+CAML_CHECKED_STUB1(WindowShouldClose)
+
 CAMLprim value caml_glfwSetWindowShouldClose(value window, value val)
 {
     glfwSetWindowShouldClose(Cptr_val(GLFWwindow*, window), Bool_val(val));
@@ -668,12 +1517,22 @@ CAMLprim value caml_glfwSetWindowShouldClose(value window, value val)
 
 CAMLprim value caml_glfwSetWindowTitle(value window, value title)
 {
+    uint64_t probe_start = probe_begin();
+
     glfwSetWindowTitle(Cptr_val(GLFWwindow*, window), String_val(title));
+    probe_end(ProbeSetWindowTitle, probe_start);
     raise_if_error();
     return Val_unit;
 }
 
-CAMLprim value caml_glfwSetWindowIcon(value window, value images)
+/* Image.t and BigarrayImage.t only differ by the type of their pixels. */
+static inline unsigned char* image_pixels(value image, int bigarray)
+{
+    return bigarray ? Caml_ba_data_val(Field(image, 2))
+                    : Bytes_val(Field(image, 2));
+}
+
+static void set_window_icon(value window, value images, int bigarray)
 {
     unsigned int count = 0;
     value iter = images;
@@ -691,12 +1550,23 @@ CAMLprim value caml_glfwSetWindowIcon(value window, value images)
         value ml_image = Field(iter, 0);
         glfw_images[i].width = Int_val(Field(ml_image, 0));
         glfw_images[i].height = Int_val(Field(ml_image, 1));
-        glfw_images[i].pixels = Bytes_val(Field(ml_image, 2));
+        glfw_images[i].pixels = image_pixels(ml_image, bigarray);
         iter = Field(iter, 1);
     }
     glfwSetWindowIcon(Cptr_val(GLFWwindow*, window), count, glfw_images);
     free(glfw_images);
     raise_if_error();
+}
+
+CAMLprim value caml_glfwSetWindowIcon(value window, value images)
+{
+    set_window_icon(window, images, 0);
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwSetWindowIconBigarray(value window, value images)
+{
+    set_window_icon(window, images, 1);
     return Val_unit;
 }
 
@@ -809,20 +1679,60 @@ CAMLprim value caml_glfwGetWindowContentScale(value window)
     CAMLreturn(ret);
 }
 
-CAMLprim value caml_glfwGetWindowOpacity(value window)
+/* The split getters below are meant for per-frame queries and allocate
+   nothing in native code unless they raise. */
+CAMLprim double caml_glfwGetWindowContentScaleX(value window)
+{
+    float xscale;
+
+    glfwGetWindowContentScale(Cptr_val(GLFWwindow*, window), &xscale, NULL);
+    raise_if_error();
+    return xscale;
+}
+
+CAMLprim value caml_glfwGetWindowContentScaleX_byte(value window)
+{
+    return caml_copy_double(caml_glfwGetWindowContentScaleX(window));
+}
+
+CAMLprim double caml_glfwGetWindowContentScaleY(value window)
+{
+    float yscale;
+
+    glfwGetWindowContentScale(Cptr_val(GLFWwindow*, window), NULL, &yscale);
+    raise_if_error();
+    return yscale;
+}
+
+CAMLprim value caml_glfwGetWindowContentScaleY_byte(value window)
+{
+    return caml_copy_double(caml_glfwGetWindowContentScaleY(window));
+}
+
+CAMLprim double caml_glfwGetWindowOpacity(value window)
 {
     float opacity = glfwGetWindowOpacity(Cptr_val(GLFWwindow*, window));
     raise_if_error();
-    return caml_copy_double(opacity);
+    return opacity;
+}
+
+CAMLprim value caml_glfwGetWindowOpacity_byte(value window)
+{
+    return caml_copy_double(caml_glfwGetWindowOpacity(window));
 }
 
-CAMLprim value caml_glfwSetWindowOpacity(value window, value time)
+CAMLprim value caml_glfwSetWindowOpacity(value window, double opacity)
 {
-    glfwSetWindowOpacity(Cptr_val(GLFWwindow*, window), Double_val(time));
+    glfwSetWindowOpacity(Cptr_val(GLFWwindow*, window), opacity);
     raise_if_error();
     return Val_unit;
 }
 
+CAMLprim value caml_glfwSetWindowOpacity_byte(value window, value opacity)
+{
+    return caml_glfwSetWindowOpacity(window, Double_val(opacity));
+}
+
 CAMLprim value caml_glfwIconifyWindow(value window)
 {
     glfwIconifyWindow(Cptr_val(GLFWwindow*, window));
@@ -971,577 +1881,3381 @@ CAMLprim value caml_glfwSetWindowAttrib(value window, value hint, value ml_val)
     return Val_unit;
 }
 
-void window_pos_callback_stub(GLFWwindow* window, int xpos, int ypos)
+/* Event queue. Windows attached to it have their events recorded into a
+   ring buffer instead of being dispatched to closures, which OCaml then reads
+   back in one pass. The order of this enumeration must match the one of the
+   EventQueue.kind type. */
+enum ml_event_kind
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-
-    caml_callback3(ml_window_callbacks->window_pos, Val_cptr(window),
-                   Val_int(xpos), Val_int(ypos));
-}
-
-CAML_WINDOW_SETTER_STUB(glfwSetWindowPosCallback, window_pos)
+    EventWindowPos,
+    EventWindowSize,
+    EventWindowClose,
+    EventWindowRefresh,
+    EventWindowFocus,
+    EventWindowIconify,
+    EventWindowMaximize,
+    EventFramebufferSize,
+    EventWindowContentScale,
+    EventKey,
+    EventChar,
+    EventCharMods,
+    EventMouseButton,
+    EventCursorPos,
+    EventCursorEnter,
+    EventScroll
+};
 
-void window_size_callback_stub(GLFWwindow* window, int width, int height)
+struct ml_event
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    enum ml_event_kind kind;
+    GLFWwindow* window;
+    int ints[4];
+    double floats[2];
+};
 
-    caml_callback3(ml_window_callbacks->window_size, Val_cptr(window),
-                   Val_int(width), Val_int(height));
-}
+/* Input recording. Events reaching the callback and queue stubs are appended
+   to a file as compact records: the kind of event on one byte, the number
+   of timer ticks elapsed since the previous record, the window serial (or
+   joystick, or monitor position), then the arguments of the event, integers
+   as zigzag-encoded LEB128 varints and floating-point values as 8 bytes in
+   little-endian order. Drops store the number of paths followed by each
+   path prefixed by its length. The file starts with RECORDING_MAGIC and the
+   frequency of the timer. */
+enum { RecordDrop = EventScroll + 1, RecordJoystick, RecordMonitor };
+
+#define RECORDING_MAGIC "GLFWREC1"
+#define RECORD_MAX_SIZE 96
+
+static const unsigned char record_int_count[] = {
+    2, 2, 0, 0, 1, 1, 1, 2, 0, 4, 1, 2, 3, 0, 1, 0
+};
+static const unsigned char record_float_count[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 2, 0, 2
+};
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowSizeCallback, window_size)
+static FILE* recorder_file = NULL;
+static uint64_t recorder_last_time;
+static int recorder_suspended = 0;
 
-void window_close_callback_stub(GLFWwindow* window)
+static inline unsigned char* put_varint(unsigned char* p, uint64_t v)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-
-    caml_callback(ml_window_callbacks->window_close, Val_cptr(window));
+    while (v >= 0x80)
+    {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowCloseCallback, window_close)
-
-void window_refresh_callback_stub(GLFWwindow* window)
+static inline unsigned char* put_int(unsigned char* p, int64_t v)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-
-    caml_callback(ml_window_callbacks->window_refresh, Val_cptr(window));
+    return put_varint(p, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowRefreshCallback, window_refresh)
-
-void window_focus_callback_stub(GLFWwindow* window, int focused)
+static inline unsigned char* put_double(unsigned char* p, double d)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    uint64_t bits;
 
-    caml_callback2(
-        ml_window_callbacks->window_focus, Val_cptr(window), Val_bool(focused));
+    memcpy(&bits, &d, sizeof(bits));
+    for (int i = 0; i < 8; ++i)
+        *p++ = (unsigned char)(bits >> (8 * i));
+    return p;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowFocusCallback, window_focus)
-
-void window_iconify_callback_stub(GLFWwindow* window, int iconified)
+static unsigned char* record_header(unsigned char* p, int kind, uint64_t id)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    uint64_t now = glfwGetTimerValue();
 
-    caml_callback2(ml_window_callbacks->window_iconify, Val_cptr(window),
-                   Val_bool(iconified));
+    *p++ = (unsigned char)kind;
+    p = put_varint(p, now - recorder_last_time);
+    recorder_last_time = now;
+    return put_varint(p, id);
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowIconifyCallback, window_iconify)
-
-void window_maximize_callback_stub(GLFWwindow* window, int maximized)
+static void record_event(enum ml_event_kind kind, GLFWwindow* window,
+                         const int* ints, const double* floats)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-
-    caml_callback2(ml_window_callbacks->window_maximize, Val_cptr(window),
-                   Val_bool(maximized));
+    unsigned char buffer[RECORD_MAX_SIZE];
+    unsigned char* p = record_header(
+        buffer, kind, window_states[window_id(window)].serial);
+
+    for (int i = 0; i < record_int_count[kind]; ++i)
+        p = put_int(p, ints[i]);
+    for (int i = 0; i < record_float_count[kind]; ++i)
+        p = put_double(p, floats[i]);
+    fwrite(buffer, 1, p - buffer, recorder_file);
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowMaximizeCallback, window_maximize)
+static inline int recording(void)
+{
+    return recorder_file != NULL && !recorder_suspended;
+}
 
-void framebuffer_size_callback_stub(GLFWwindow* window, int width, int height)
+static inline void record_ints(enum ml_event_kind kind, GLFWwindow* window,
+                               int a, int b, int c, int d)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    if (recording())
+    {
+        int ints[4] = {a, b, c, d};
+        record_event(kind, window, ints, NULL);
+    }
+}
 
-    caml_callback3(ml_window_callbacks->framebuffer_size, Val_cptr(window),
-                   Val_int(width), Val_int(height));
+static inline void record_floats(enum ml_event_kind kind, GLFWwindow* window,
+                                 double x, double y)
+{
+    if (recording())
+    {
+        double floats[2] = {x, y};
+        record_event(kind, window, NULL, floats);
+    }
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetFramebufferSizeCallback, framebuffer_size)
+static void record_drop(GLFWwindow* window, int count, const char** paths)
+{
+    unsigned char buffer[RECORD_MAX_SIZE];
+    unsigned char* p;
+
+    if (!recording())
+        return;
+    p = put_varint(record_header(buffer, RecordDrop,
+                                 window_states[window_id(window)].serial),
+                   count);
+    fwrite(buffer, 1, p - buffer, recorder_file);
+    for (int i = 0; i < count; ++i)
+    {
+        size_t length = strlen(paths[i]);
+        p = put_varint(buffer, length);
+        fwrite(buffer, 1, p - buffer, recorder_file);
+        fwrite(paths[i], 1, length, recorder_file);
+    }
+}
 
-void window_content_scale_callback_stub(GLFWwindow* window, float xscale,
-                                        float yscale)
+static void record_device(int kind, int device, int event)
 {
-    CAMLparam0();
-    CAMLlocal2(ml_xscale, ml_yscale);
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    unsigned char buffer[RECORD_MAX_SIZE];
+    unsigned char* p;
 
-    ml_xscale = caml_copy_double(xscale);
-    ml_yscale = caml_copy_double(yscale);
-    caml_callback3(ml_window_callbacks->window_content_scale, Val_cptr(window),
-                   ml_xscale, ml_yscale);
-    CAMLreturn0;
+    if (!recording())
+        return;
+    p = put_int(record_header(buffer, kind, device), event);
+    fwrite(buffer, 1, p - buffer, recorder_file);
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowContentScaleCallback, window_content_scale)
-
-CAMLprim value caml_glfwPollEvents(CAMLvoid)
+/* Monitors are recorded by their position in glfwGetMonitors, -1 for a
+   disconnected monitor, which GLFW removes before reporting it. */
+static void record_monitor(GLFWmonitor* monitor, int event)
 {
-    glfwPollEvents();
-    raise_if_error();
-    return Val_unit;
+    int count, index = -1;
+    GLFWmonitor** monitors;
+
+    if (!recording())
+        return;
+    monitors = glfwGetMonitors(&count);
+    for (int i = 0; i < count; ++i)
+        if (monitors[i] == monitor)
+            index = i;
+    record_device(RecordMonitor, index + 1, event);
 }
 
-CAMLprim value caml_glfwWaitEvents(CAMLvoid)
+CAMLprim value caml_glfwRecorderStart(value path)
 {
-    glfwWaitEvents();
-    raise_if_error();
+    FILE* file;
+    unsigned char buffer[8];
+
+    if (recorder_file != NULL)
+        caml_invalid_argument("Recorder.start: already recording.");
+    file = fopen(String_val(path), "wb");
+    if (file == NULL)
+        raise_sys_error(path);
+    recorder_last_time = glfwGetTimerValue();
+    fwrite(RECORDING_MAGIC, 1, 8, file);
+    for (int i = 0; i < 8; ++i)
+        buffer[i] = (unsigned char)(glfwGetTimerFrequency() >> (8 * i));
+    fwrite(buffer, 1, 8, file);
+    recorder_file = file;
     return Val_unit;
 }
 
-CAMLprim value caml_glfwWaitEventsTimeout(value timeout)
+CAMLprim value caml_glfwRecorderStop(CAMLvoid)
 {
-    glfwWaitEventsTimeout(Double_val(timeout));
-    raise_if_error();
+    if (recorder_file != NULL)
+    {
+        int failed = ferror(recorder_file) != 0;
+        failed |= fclose(recorder_file) != 0;
+        recorder_file = NULL;
+        if (failed)
+            caml_failwith("Recorder.stop: could not write the recording.");
+    }
     return Val_unit;
 }
 
-CAMLprim value caml_glfwPostEmptyEvent(CAMLvoid)
+CAMLprim value caml_glfwRecorderRecording(CAMLvoid)
 {
-    glfwPostEmptyEvent();
-    raise_if_error();
-    return Val_unit;
+    return Val_bool(recorder_file != NULL);
 }
 
-CAMLprim value caml_glfwGetInputMode(value window, value mode)
+#define EVENT_QUEUE_DEFAULT_CAPACITY 1024
+
+static struct ml_event* event_queue = NULL;
+static unsigned int event_queue_capacity = 0;
+static unsigned int event_queue_head = 0;
+static unsigned int event_queue_length = 0;
+static uintnat event_queue_dropped = 0;
+
+/* When the queue is full the oldest event is overwritten. */
+static struct ml_event* event_queue_push(
+    enum ml_event_kind kind, GLFWwindow* window)
 {
-    int v = glfwGetInputMode(Cptr_val(GLFWwindow*, window),
-                             Int_val(mode) + GLFW_CURSOR);
+    struct ml_event* event;
 
-    raise_if_error();
-    if (Int_val(mode) == 0)
-        return Val_int(v - GLFW_CURSOR_NORMAL);
-    return Val_bool(v);
+    if (event_queue_length == event_queue_capacity)
+    {
+        event_queue_head = (event_queue_head + 1) % event_queue_capacity;
+        --event_queue_length;
+        ++event_queue_dropped;
+    }
+    event = event_queue + (event_queue_head + event_queue_length++)
+        % event_queue_capacity;
+    event->kind = kind;
+    event->window = window;
+    return event;
 }
 
-CAMLprim value caml_glfwSetInputMode(value window, value mode, value v)
+static inline struct ml_event* event_queue_get(value index)
 {
-    int glfw_val =
-        Int_val(mode) == 0 ? Int_val(v) + GLFW_CURSOR_NORMAL : Bool_val(v);
-
-    glfwSetInputMode(
-        Cptr_val(GLFWwindow*, window), Int_val(mode) + GLFW_CURSOR, glfw_val);
-    raise_if_error();
-    return Val_unit;
+    return event_queue
+        + (event_queue_head + Long_val(index)) % event_queue_capacity;
 }
 
-CAMLprim value caml_glfwRawMouseMotionSupported(CAMLvoid)
+static void window_pos_queue_stub(GLFWwindow* window, int xpos, int ypos)
 {
-    const int ret = glfwRawMouseMotionSupported();
-    raise_if_error();
-    return Val_bool(ret);
+    record_ints(EventWindowPos, window, xpos, ypos, 0, 0);
+    struct ml_event* event = event_queue_push(EventWindowPos, window);
+    event->ints[0] = xpos;
+    event->ints[1] = ypos;
 }
 
-CAMLprim value caml_glfwGetKeyName(value key, value scancode)
+static void window_size_queue_stub(GLFWwindow* window, int width, int height)
 {
-    const char* name =
-        glfwGetKeyName(ml_to_glfw_key[Int_val(key)], Int_val(scancode));
+    record_ints(EventWindowSize, window, width, height, 0, 0);
+    struct ml_event* event = event_queue_push(EventWindowSize, window);
+    event->ints[0] = width;
+    event->ints[1] = height;
+}
 
-    raise_if_error();
-    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+static void window_close_queue_stub(GLFWwindow* window)
+{
+    record_ints(EventWindowClose, window, 0, 0, 0, 0);
+    event_queue_push(EventWindowClose, window);
 }
 
-CAMLprim value caml_glfwGetKeyScancode(value key)
+static void window_refresh_queue_stub(GLFWwindow* window)
 {
-    int ret = glfwGetKeyScancode(ml_to_glfw_key[Int_val(key)]);
-    raise_if_error();
-    return Val_int(ret);
+    record_ints(EventWindowRefresh, window, 0, 0, 0, 0);
+    event_queue_push(EventWindowRefresh, window);
 }
 
-CAMLprim value caml_glfwGetKey(value window, value key)
+static void window_focus_queue_stub(GLFWwindow* window, int focused)
 {
-    int ret =
-        glfwGetKey(Cptr_val(GLFWwindow*, window), ml_to_glfw_key[Int_val(key)]);
-    raise_if_error();
-    return Val_bool(ret);
+    record_ints(EventWindowFocus, window, focused, 0, 0, 0);
+    event_queue_push(EventWindowFocus, window)->ints[0] = focused;
 }
 
-CAMLprim value caml_glfwGetMouseButton(value window, value button)
+static void window_iconify_queue_stub(GLFWwindow* window, int iconified)
 {
-    int ret =
-        glfwGetMouseButton(Cptr_val(GLFWwindow*, window), Int_val(button));
-    raise_if_error();
-    return Val_bool(ret);
+    record_ints(EventWindowIconify, window, iconified, 0, 0, 0);
+    event_queue_push(EventWindowIconify, window)->ints[0] = iconified;
 }
 
-CAMLprim value caml_glfwGetCursorPos(value window)
+static void window_maximize_queue_stub(GLFWwindow* window, int maximized)
 {
-    CAMLparam0();
-    CAMLlocal3(ml_xpos, ml_ypos, ret);
-    double xpos, ypos;
+    record_ints(EventWindowMaximize, window, maximized, 0, 0, 0);
+    event_queue_push(EventWindowMaximize, window)->ints[0] = maximized;
+}
 
-    glfwGetCursorPos(Cptr_val(GLFWwindow*, window), &xpos, &ypos);
-    raise_if_error();
-    ml_xpos = caml_copy_double(xpos);
-    ml_ypos = caml_copy_double(ypos);
-    ret = caml_alloc_small(2, 0);
-    Field(ret, 0) = ml_xpos;
-    Field(ret, 1) = ml_ypos;
-    CAMLreturn(ret);
+static void framebuffer_size_queue_stub(
+    GLFWwindow* window, int width, int height)
+{
+    record_ints(EventFramebufferSize, window, width, height, 0, 0);
+    struct ml_event* event = event_queue_push(EventFramebufferSize, window);
+    event->ints[0] = width;
+    event->ints[1] = height;
 }
 
-CAMLprim value caml_glfwSetCursorPos(value window, value xpos, value ypos)
+static void window_content_scale_queue_stub(
+    GLFWwindow* window, float xscale, float yscale)
 {
-    glfwSetCursorPos(
-        Cptr_val(GLFWwindow*, window), Double_val(xpos), Double_val(ypos));
-    raise_if_error();
-    return Val_unit;
+    record_floats(EventWindowContentScale, window, xscale, yscale);
+    struct ml_event* event = event_queue_push(EventWindowContentScale, window);
+    event->floats[0] = xscale;
+    event->floats[1] = yscale;
 }
 
-CAMLprim value caml_glfwCreateCursor(value image, value xhot, value yhot)
+static void key_queue_stub(
+    GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-    GLFWimage glfw_image;
-    GLFWcursor* ret;
+    record_ints(EventKey, window, key, scancode, action, mods);
+    struct ml_event* event = event_queue_push(EventKey, window);
+    event->ints[0] = glfw_to_ml_key[key - GLFW_KEY_FIRST];
+    event->ints[1] = scancode;
+    event->ints[2] = action;
+    event->ints[3] = mods;
+}
 
-    glfw_image.width = Int_val(Field(image, 0));
-    glfw_image.height = Int_val(Field(image, 1));
-    glfw_image.pixels = Bytes_val(Field(image, 2));
-    ret = glfwCreateCursor(&glfw_image, Int_val(xhot), Int_val(yhot));
-    raise_if_error();
-    return Val_cptr(ret);
+static void character_queue_stub(GLFWwindow* window, unsigned int codepoint)
+{
+    record_ints(EventChar, window, codepoint, 0, 0, 0);
+    event_queue_push(EventChar, window)->ints[0] = codepoint;
 }
 
-CAMLprim value caml_glfwCreateStandardCursor(value shape)
+static void character_mods_queue_stub(
+    GLFWwindow* window, unsigned int codepoint, int mods)
 {
-    GLFWcursor* ret =
-        glfwCreateStandardCursor(GLFW_ARROW_CURSOR + Int_val(shape));
-    raise_if_error();
-    return Val_cptr(ret);
+    record_ints(EventCharMods, window, codepoint, mods, 0, 0);
+    struct ml_event* event = event_queue_push(EventCharMods, window);
+    event->ints[0] = codepoint;
+    event->ints[1] = mods;
 }
 
-CAMLprim value caml_glfwDestroyCursor(value cursor)
+static void mouse_button_queue_stub(
+    GLFWwindow* window, int button, int action, int mods)
 {
-    glfwDestroyCursor(Cptr_val(GLFWcursor*, cursor));
-    raise_if_error();
-    return Val_unit;
+    record_ints(EventMouseButton, window, button, action, mods, 0);
+    struct ml_event* event = event_queue_push(EventMouseButton, window);
+    event->ints[0] = button;
+    event->ints[1] = action;
+    event->ints[2] = mods;
 }
 
-CAMLprim value caml_glfwSetCursor(value window, value cursor)
+static void cursor_pos_queue_stub(GLFWwindow* window, double xpos, double ypos)
 {
-    glfwSetCursor(Cptr_val(GLFWwindow*, window), Cptr_val(GLFWcursor*, cursor));
-    raise_if_error();
-    return Val_unit;
+    record_floats(EventCursorPos, window, xpos, ypos);
+    struct ml_event* event = event_queue_push(EventCursorPos, window);
+    event->floats[0] = xpos;
+    event->floats[1] = ypos;
 }
 
-void key_callback_stub(
-    GLFWwindow* window, int key, int scancode, int action, int mods)
+static void cursor_enter_queue_stub(GLFWwindow* window, int entered)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-    value args[] = {
-        Val_cptr(window), Val_int(glfw_to_ml_key[key - GLFW_KEY_FIRST]),
-        Val_int(scancode), Val_int(action), caml_list_of_flags(mods, 4)
-    };
+    record_ints(EventCursorEnter, window, entered, 0, 0, 0);
+    event_queue_push(EventCursorEnter, window)->ints[0] = entered;
+}
 
-    caml_callbackN(
-        ml_window_callbacks->key, sizeof(args) / sizeof(*args), args);
+static void scroll_queue_stub(
+    GLFWwindow* window, double xoffset, double yoffset)
+{
+    record_floats(EventScroll, window, xoffset, yoffset);
+    struct ml_event* event = event_queue_push(EventScroll, window);
+    event->floats[0] = xoffset;
+    event->floats[1] = yoffset;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetKeyCallback, key)
+/* Event coalescing. Cursor positions and scroll offsets of a coalescing
+   window are accumulated here and delivered once, either at the end of
+   pollEvents and waitEvents or before any other event of the same window
+   so that ordering is preserved. */
+void cursor_pos_callback_stub(GLFWwindow* window, double xpos, double ypos);
+void scroll_callback_stub(GLFWwindow* window, double xoffset, double yoffset);
 
-void character_callback_stub(GLFWwindow* window, unsigned int codepoint)
+static inline struct ml_window_state* coalesce_state(GLFWwindow* window)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    uintnat id = window_id(window);
 
-    caml_callback2(
-        ml_window_callbacks->character, Val_cptr(window), Val_int(codepoint));
+    if (!window_states[id].listed)
+    {
+        window_states[id].listed = 1;
+        pending_window_ids[pending_window_count++] = id;
+    }
+    return &window_states[id];
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetCharCallback, character)
-
-void character_mods_callback_stub(
-    GLFWwindow* window, unsigned int codepoint, int mods)
+static void cursor_pos_coalesce_stub(
+    GLFWwindow* window, double xpos, double ypos)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-    value ml_mods = caml_list_of_flags(mods, 4);
+    struct ml_window_state* state = coalesce_state(window);
 
-    caml_callback3(ml_window_callbacks->character_mods, Val_cptr(window),
-                   Val_int(codepoint), ml_mods);
+    state->cursor_pos_pending = 1;
+    state->cursor_x = xpos;
+    state->cursor_y = ypos;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetCharModsCallback, character_mods)
-
-void mouse_button_callback_stub(
-    GLFWwindow* window, int button, int action, int mods)
+static void scroll_coalesce_stub(
+    GLFWwindow* window, double xoffset, double yoffset)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-    value args[] = {
-        Val_cptr(window), Val_int(button), Val_bool(action),
-        caml_list_of_flags(mods, 4)
-    };
+    struct ml_window_state* state = coalesce_state(window);
 
-    caml_callbackN(
-        ml_window_callbacks->mouse_button, sizeof(args) / sizeof(*args), args);
+    if (!state->scroll_pending)
+    {
+        state->scroll_pending = 1;
+        state->scroll_x = 0.;
+        state->scroll_y = 0.;
+    }
+    state->scroll_x += xoffset;
+    state->scroll_y += yoffset;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetMouseButtonCallback, mouse_button)
+/* The states may be reallocated by a callback creating a window, hence the
+   copies. */
+static void flush_coalesced_events(uintnat id)
+{
+    GLFWwindow* window = window_states[id].window;
 
-void cursor_pos_callback_stub(GLFWwindow* window, double xpos, double ypos)
+    if (window_states[id].cursor_pos_pending)
+    {
+        double xpos = window_states[id].cursor_x;
+        double ypos = window_states[id].cursor_y;
+
+        window_states[id].cursor_pos_pending = 0;
+        if (window_callbacks(window)->cursor_pos != Val_unit)
+            cursor_pos_callback_stub(window, xpos, ypos);
+    }
+    if (window_states[id].scroll_pending)
+    {
+        double xoffset = window_states[id].scroll_x;
+        double yoffset = window_states[id].scroll_y;
+
+        window_states[id].scroll_pending = 0;
+        if (window_callbacks(window)->scroll != Val_unit)
+            scroll_callback_stub(window, xoffset, yoffset);
+    }
+}
+
+/* Called by the other callback stubs before they take the runtime lock. */
+static inline void flush_window_events(GLFWwindow* window)
 {
-    CAMLparam0();
-    CAMLlocal2(ml_xpos, ml_ypos);
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    uintnat id = window_id(window);
 
-    ml_xpos = caml_copy_double(xpos);
-    ml_ypos = caml_copy_double(ypos);
-    caml_callback3(
-        ml_window_callbacks->cursor_pos, Val_cptr(window), ml_xpos, ml_ypos);
-    CAMLreturn0;
+    if (window_states[id].cursor_pos_pending
+        || window_states[id].scroll_pending)
+        flush_coalesced_events(id);
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetCursorPosCallback, cursor_pos)
+static void flush_all_coalesced_events(void)
+{
+    while (pending_window_count > 0)
+    {
+        uintnat id = pending_window_ids[--pending_window_count];
 
-void cursor_enter_callback_stub(GLFWwindow* window, int entered)
+        window_states[id].listed = 0;
+        flush_coalesced_events(id);
+    }
+}
+
+void window_pos_callback_stub(GLFWwindow* window, int xpos, int ypos)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    flush_window_events(window);
+    record_ints(EventWindowPos, window, xpos, ypos, 0, 0);
+    int released = callback_enter(ProbeWindowPos);
+
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
 
-    caml_callback2(
-        ml_window_callbacks->cursor_enter, Val_cptr(window), Val_bool(entered));
+    callback_leave(released, caml_callback3_exn(
+        ml_window_callbacks->window_pos, Val_cptr(window), Val_int(xpos),
+        Val_int(ypos)));
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetCursorEnterCallback, cursor_enter)
+CAML_WINDOW_INSTALLER(glfwSetWindowPosCallback, window_pos)
+CAML_WINDOW_SETTER_STUB(glfwSetWindowPosCallback, window_pos)
 
-void scroll_callback_stub(GLFWwindow* window, double xoffset, double yoffset)
+void window_size_callback_stub(GLFWwindow* window, int width, int height)
 {
-    CAMLparam0();
-    CAMLlocal2(ml_xoffset, ml_yoffset);
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    flush_window_events(window);
+    record_ints(EventWindowSize, window, width, height, 0, 0);
+    int released = callback_enter(ProbeWindowSize);
 
-    ml_xoffset = caml_copy_double(xoffset);
-    ml_yoffset = caml_copy_double(yoffset);
-    caml_callback3(
-        ml_window_callbacks->scroll, Val_cptr(window), ml_xoffset, ml_yoffset);
-    CAMLreturn0;
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    callback_leave(released, caml_callback3_exn(
+        ml_window_callbacks->window_size, Val_cptr(window), Val_int(width),
+        Val_int(height)));
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetScrollCallback, scroll)
+CAML_WINDOW_INSTALLER(glfwSetWindowSizeCallback, window_size)
+CAML_WINDOW_SETTER_STUB(glfwSetWindowSizeCallback, window_size)
 
-void drop_callback_stub(GLFWwindow* window, int count, const char** paths)
+void window_close_callback_stub(GLFWwindow* window)
 {
-    CAMLparam0();
-    CAMLlocal2(ml_paths, str);
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    flush_window_events(window);
+    record_ints(EventWindowClose, window, 0, 0, 0, 0);
+    int released = callback_enter(ProbeWindowClose);
 
-    ml_paths = Val_emptylist;
-    while (count > 0)
-    {
-        str = caml_copy_string(paths[--count]);
-        value tmp = caml_alloc_small(2, 0);
-        Field(tmp, 0) = str;
-        Field(tmp, 1) = ml_paths;
-        ml_paths = tmp;
-    }
-    caml_callback2(ml_window_callbacks->drop, Val_cptr(window), ml_paths);
-    CAMLreturn0;
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    callback_leave(released, caml_callback_exn(
+        ml_window_callbacks->window_close, Val_cptr(window)));
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetDropCallback, drop)
+CAML_WINDOW_INSTALLER(glfwSetWindowCloseCallback, window_close)
+CAML_WINDOW_SETTER_STUB(glfwSetWindowCloseCallback, window_close)
 
-CAMLprim value caml_glfwJoystickPresent(value joy)
+void window_refresh_callback_stub(GLFWwindow* window)
 {
-    int ret = glfwJoystickPresent(Int_val(joy));
-    raise_if_error();
-    return Val_bool(ret);
+    flush_window_events(window);
+    record_ints(EventWindowRefresh, window, 0, 0, 0, 0);
+    int released = callback_enter(ProbeWindowRefresh);
+
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    callback_leave(released, caml_callback_exn(
+        ml_window_callbacks->window_refresh, Val_cptr(window)));
 }
 
-CAMLprim value caml_glfwGetJoystickAxes(value joy)
+CAML_WINDOW_INSTALLER(glfwSetWindowRefreshCallback, window_refresh)
+CAML_WINDOW_SETTER_STUB(glfwSetWindowRefreshCallback, window_refresh)
+
+void window_focus_callback_stub(GLFWwindow* window, int focused)
 {
-    value ret;
-    int count;
-    const float* axes = glfwGetJoystickAxes(Int_val(joy), &count);
+    flush_window_events(window);
+    record_ints(EventWindowFocus, window, focused, 0, 0, 0);
+    int released = callback_enter(ProbeWindowFocus);
 
-    raise_if_error();
-    ret = caml_alloc_float_array(count);
-    for (int i = 0; i < count; ++i)
-        Store_double_field(ret, i, axes[i]);
-    return ret;
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    callback_leave(released, caml_callback2_exn(
+        ml_window_callbacks->window_focus, Val_cptr(window),
+        Val_bool(focused)));
 }
 
-CAMLprim value caml_glfwGetJoystickButtons(value joy)
+CAML_WINDOW_INSTALLER(glfwSetWindowFocusCallback, window_focus)
+CAML_WINDOW_SETTER_STUB(glfwSetWindowFocusCallback, window_focus)
+
+void window_iconify_callback_stub(GLFWwindow* window, int iconified)
 {
-    value ret;
-    int count;
-    const unsigned char* buttons = glfwGetJoystickButtons(Int_val(joy), &count);
+    flush_window_events(window);
+    record_ints(EventWindowIconify, window, iconified, 0, 0, 0);
+    int released = callback_enter(ProbeWindowIconify);
 
-    raise_if_error();
-    if (count == 0)
-        return Atom(0);
-    ret = caml_alloc_small(count, 0);
-    for (int i = 0; i < count; ++i)
-        Field(ret, i) = Val_bool(buttons[i] == GLFW_PRESS);
-    return ret;
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    callback_leave(released, caml_callback2_exn(
+        ml_window_callbacks->window_iconify, Val_cptr(window),
+        Val_bool(iconified)));
 }
 
-CAMLprim value caml_glfwGetJoystickHats(value joy)
+CAML_WINDOW_INSTALLER(glfwSetWindowIconifyCallback, window_iconify)
+CAML_WINDOW_SETTER_STUB(glfwSetWindowIconifyCallback, window_iconify)
+
+void window_maximize_callback_stub(GLFWwindow* window, int maximized)
 {
-    CAMLparam0();
-    CAMLlocal1(ret);
-    int count;
-    const unsigned char* hats = glfwGetJoystickHats(Int_val(joy), &count);
+    flush_window_events(window);
+    record_ints(EventWindowMaximize, window, maximized, 0, 0, 0);
+    int released = callback_enter(ProbeWindowMaximize);
 
-    raise_if_error();
-    if (count == 0)
-        ret = Atom(0);
-    else
-    {
-        ret = caml_alloc_small(count, 0);
-        for (int i = 0; i < count; ++i)
-            Field(ret, i) = Val_unit;
-        for (int i = 0; i < count; ++i)
-            Store_field(ret, i, caml_list_of_flags(hats[i], 4));
-    }
-    CAMLreturn(ret);
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    callback_leave(released, caml_callback2_exn(
+        ml_window_callbacks->window_maximize, Val_cptr(window),
+        Val_bool(maximized)));
 }
 
-CAMLprim value caml_glfwGetJoystickGUID(value joy)
+CAML_WINDOW_INSTALLER(glfwSetWindowMaximizeCallback, window_maximize)
+CAML_WINDOW_SETTER_STUB(glfwSetWindowMaximizeCallback, window_maximize)
+
+void framebuffer_size_callback_stub(GLFWwindow* window, int width, int height)
 {
-    const char* name = glfwGetJoystickGUID(Int_val(joy));
+    flush_window_events(window);
+    record_ints(EventFramebufferSize, window, width, height, 0, 0);
+    int released = callback_enter(ProbeFramebufferSize);
 
-    raise_if_error();
-    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    callback_leave(released, caml_callback3_exn(
+        ml_window_callbacks->framebuffer_size, Val_cptr(window),
+        Val_int(width), Val_int(height)));
 }
 
-CAMLprim value caml_glfwGetJoystickName(value joy)
+CAML_WINDOW_INSTALLER(glfwSetFramebufferSizeCallback, framebuffer_size)
+CAML_WINDOW_SETTER_STUB(glfwSetFramebufferSizeCallback, framebuffer_size)
+
+void window_content_scale_callback_stub(GLFWwindow* window, float xscale,
+                                        float yscale)
 {
-    const char* name = glfwGetJoystickName(Int_val(joy));
+    flush_window_events(window);
+    record_floats(EventWindowContentScale, window, xscale, yscale);
+    int released = callback_enter(ProbeWindowContentScale);
 
-    raise_if_error();
-    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+    CAMLparam0();
+    CAMLlocal2(ml_xscale, ml_yscale);
+    value result;
+
+    ml_xscale = caml_copy_double(xscale);
+    ml_yscale = caml_copy_double(yscale);
+    result = caml_callback3_exn(window_callbacks(window)->window_content_scale,
+                                Val_cptr(window), ml_xscale, ml_yscale);
+    CAMLdrop;
+    callback_leave(released, result);
 }
 
-CAMLprim value caml_glfwJoystickIsGamepad(value joy)
+CAML_WINDOW_INSTALLER(glfwSetWindowContentScaleCallback, window_content_scale)
+CAML_WINDOW_SETTER_STUB(glfwSetWindowContentScaleCallback, window_content_scale)
+
+static void animated_cursors_tick(void);
+
+/* Event loop integration. Rather than blocking in waitEvents, an external
+   scheduler may wait for the display connection and the wake-up descriptor
+   to become readable along with its own descriptors, then call pollEvents.
+   postEmptyEvent notifies the wake-up descriptor and pollEvents drains it.
+   Both ends are the same eventfd on Linux and the ends of a pipe elsewhere. */
+static int wakeup_read_fd = -1;
+static int wakeup_write_fd = -1;
+
+#if defined(__GNUC__) && !defined(_WIN32) && !defined(__APPLE__)
+/* Weak references so that neither the X11 nor the Wayland headers and
+   libraries are required, GLFW being built for either of them or both,
+   nor libdl on systems where it is separate from libc. */
+# define ML_DISPLAY_FD
+# include <dlfcn.h>
+# pragma weak dlopen
+# pragma weak dlsym
+# pragma weak dlclose
+extern void* glfwGetX11Display(void) __attribute__((weak));
+extern void* glfwGetWaylandDisplay(void) __attribute__((weak));
+
+/* Unless linked to them, GLFW loads libX11 and libwayland-client with
+   dlopen and RTLD_LOCAL, so their functions are looked up in the global
+   scope first, then in the library if it is already loaded. */
+static void* display_function(const char* const* libraries, const char* name)
 {
-    int ret = glfwJoystickIsGamepad(Int_val(joy));
-    raise_if_error();
-    return Val_bool(ret);
+    void* function;
+
+    if (dlsym == NULL)
+        return NULL;
+    function = dlsym(RTLD_DEFAULT, name);
+# ifdef RTLD_NOLOAD
+    for (; function == NULL && dlopen != NULL && *libraries != NULL;
+         ++libraries)
+    {
+        void* library = dlopen(*libraries, RTLD_LAZY | RTLD_NOLOAD);
+        if (library != NULL)
+        {
+            /* Still loaded by GLFW after closing this reference. */
+            function = dlsym(library, name);
+            dlclose(library);
+        }
+    }
+# endif
+    return function;
 }
 
-static value joystick_closure = Val_unit;
+static const char* const x11_libraries[] =
+    { "libX11.so.6", "libX11.so", NULL };
+static const char* const wayland_libraries[] =
+    { "libwayland-client.so.0", "libwayland-client.so", NULL };
+#endif
 
-void joystick_callback_stub(int joy, int event)
+static void wakeup_notify(void)
 {
-    caml_callback2(
-        joystick_closure, Val_int(joy), Val_int(event - GLFW_DISCONNECTED));
+#ifndef _WIN32
+    if (wakeup_write_fd >= 0)
+    {
+        /* Fails with EAGAIN if a notification is already pending. */
+        uint64_t one = 1;
+        ssize_t written = write(wakeup_write_fd, &one,
+                                wakeup_write_fd == wakeup_read_fd ? 8 : 1);
+        (void)written;
+    }
+#endif
 }
 
-CAML_SETTER_STUB(glfwSetJoystickCallback, joystick)
+static void wakeup_drain(void)
+{
+#ifndef _WIN32
+    if (wakeup_read_fd >= 0)
+    {
+        uint64_t buffer[8];
+        while (read(wakeup_read_fd, buffer, sizeof(buffer)) > 0)
+            ;
+    }
+#endif
+}
 
-CAMLprim value caml_glfwUpdateGamepadMappings(value string)
+CAMLprim value caml_glfwGetDisplayFd(CAMLvoid)
 {
-    glfwUpdateGamepadMappings(String_val(string));
+    int fd = -1;
+
+#ifdef ML_DISPLAY_FD
+    const char* missing = NULL;
+
+    if (glfwGetX11Display != NULL)
+    {
+        void* display = glfwGetX11Display();
+        if (display != NULL)
+        {
+            int (*connection_number)(void*) = (int (*)(void*))
+                display_function(x11_libraries, "XConnectionNumber");
+            if (connection_number != NULL)
+                fd = connection_number(display);
+            else
+                missing = "XConnectionNumber";
+        }
+    }
+    if (fd < 0 && glfwGetWaylandDisplay != NULL)
+    {
+        void* display = glfwGetWaylandDisplay();
+        if (display != NULL)
+        {
+            int (*get_fd)(void*) = (int (*)(void*))
+                display_function(wayland_libraries, "wl_display_get_fd");
+            if (get_fd != NULL)
+                fd = get_fd(display);
+            else
+                missing = "wl_display_get_fd";
+        }
+    }
+# ifdef GLFW_PLATFORM_UNAVAILABLE
+    /* Querying a platform GLFW was not initialized for is not an error. */
+    if (error_code == GLFW_PLATFORM_UNAVAILABLE)
+        error_code = GLFW_NO_ERROR;
+# endif
     raise_if_error();
-    return Val_unit;
+    if (fd < 0 && missing != NULL)
+    {
+        char message[64];
+        snprintf(message, sizeof(message),
+                 "EventLoop.displayFd: %s not found.", missing);
+        caml_failwith(message);
+    }
+#else
+    raise_if_error();
+#endif
+    return fd < 0 ? Val_none : caml_alloc_some(Val_int(fd));
 }
 
-CAMLprim value caml_glfwGetGamepadName(value joy)
+#ifdef ML_DISPLAY_FD
+static void* prepare_wait_function(
+    const char* const* libraries, const char* name)
 {
-    const char* name = glfwGetGamepadName(Int_val(joy));
+    void* function = display_function(libraries, name);
 
-    raise_if_error();
-    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+    if (function == NULL)
+    {
+        char message[64];
+        snprintf(message, sizeof(message),
+                 "EventLoop.prepareWait: %s not found.", name);
+        caml_failwith(message);
+    }
+    return function;
 }
+#endif
 
-CAMLprim value caml_glfwGetGamepadState(value joy)
+/* Xlib, and libwayland for the queues of GLFW and EGL, may read events from
+   the connection during any call, leaving them queued on the client side
+   while the descriptor is not readable anymore. Xlib is checked for queued
+   events. On Wayland, the pending events of the default queue are
+   dispatched until the queue is empty, the way wl_display_prepare_read
+   requires before a wait, then the read is cancelled as pollEvents reads
+   the events itself. Requests are flushed in both cases. */
+CAMLprim value caml_glfwEventLoopPrepareWait(CAMLvoid)
 {
-    CAMLparam0();
-    CAMLlocal3(buttons, axes, ret);
-    GLFWgamepadstate gamepad_state;
+    int pending = 0;
 
-    glfwGetGamepadState(Int_val(joy), &gamepad_state);
+#ifdef ML_DISPLAY_FD
+    void* display;
+
+    if (glfwGetX11Display != NULL && (display = glfwGetX11Display()) != NULL)
+    {
+        int (*flush)(void*) = (int (*)(void*))
+            prepare_wait_function(x11_libraries, "XFlush");
+        int (*events_queued)(void*, int) = (int (*)(void*, int))
+            prepare_wait_function(x11_libraries, "XEventsQueued");
+
+        flush(display);
+        /* QueuedAlready */
+        pending = events_queued(display, 0) > 0;
+    }
+    else if (glfwGetWaylandDisplay != NULL
+             && (display = glfwGetWaylandDisplay()) != NULL)
+    {
+        int (*prepare_read)(void*) = (int (*)(void*))
+            prepare_wait_function(wayland_libraries, "wl_display_prepare_read");
+        int (*dispatch_pending)(void*) = (int (*)(void*))
+            prepare_wait_function(wayland_libraries,
+                                  "wl_display_dispatch_pending");
+        int (*flush)(void*) = (int (*)(void*))
+            prepare_wait_function(wayland_libraries, "wl_display_flush");
+        void (*cancel_read)(void*) = (void (*)(void*))
+            prepare_wait_function(wayland_libraries, "wl_display_cancel_read");
+
+        while (prepare_read(display) != 0)
+        {
+            if (dispatch_pending(display) < 0)
+                break;
+            pending = 1;
+        }
+        /* Requests left unsent would not be answered while waiting. */
+        if (flush(display) < 0 && errno == EAGAIN)
+            pending = 1;
+        cancel_read(display);
+    }
+# ifdef GLFW_PLATFORM_UNAVAILABLE
+    if (error_code == GLFW_PLATFORM_UNAVAILABLE)
+        error_code = GLFW_NO_ERROR;
+# endif
+#endif
     raise_if_error();
-    buttons = caml_alloc_small(15, 0);
-    for (unsigned int i = 0; i < 15; ++i)
-        Field(buttons, i) = Val_bool(gamepad_state.buttons[i] == GLFW_PRESS);
-    axes = caml_alloc_float_array(6);
-    for (unsigned int i = 0; i < 6; ++i)
-        Store_double_field(axes, i, gamepad_state.axes[i]);
-    ret = caml_alloc_small(2, 0);
-    Field(ret, 0) = buttons;
-    Field(ret, 1) = axes;
-    CAMLreturn(ret);
+    return Val_bool(pending);
 }
 
-CAMLprim value caml_glfwSetClipboardString(CAMLvoid, value string)
+CAMLprim value caml_glfwGetWakeupFd(CAMLvoid)
 {
-    glfwSetClipboardString(NULL, String_val(string));
-    raise_if_error();
-    return Val_unit;
+#ifdef _WIN32
+    caml_failwith("EventLoop.wakeupFd: not supported on this platform.");
+#else
+    if (wakeup_read_fd < 0)
+    {
+# ifdef __linux__
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (fd < 0)
+            caml_failwith("EventLoop.wakeupFd: eventfd failed.");
+        wakeup_write_fd = fd;
+        wakeup_read_fd = fd;
+# else
+        int fds[2], i;
+
+        if (pipe(fds) != 0)
+            caml_failwith("EventLoop.wakeupFd: pipe failed.");
+        for (i = 0; i < 2; ++i)
+        {
+            fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        }
+        wakeup_write_fd = fds[1];
+        wakeup_read_fd = fds[0];
+# endif
+    }
+    return Val_int(wakeup_read_fd);
+#endif
 }
 
-CAMLprim value caml_glfwGetClipboardString(CAMLvoid)
+/* Runs the commands posted with MainThread.post. An exception they raise is
+   kept like those of callbacks run while the runtime lock is released, for
+   the event processing function to raise it once events are processed. */
+static void run_main_thread_commands(void)
 {
-    const char* string = glfwGetClipboardString(NULL);
-    raise_if_error();
-    return caml_copy_string(string);
+    static const value* run = NULL;
+    value result;
+
+    if (run == NULL)
+        run = caml_named_value("GLFW.MainThread.run");
+    result = caml_callback_exn(*run, Val_unit);
+    if (Is_exception_result(result) && pending_exception == Val_unit)
+        caml_modify_generational_global_root(
+            &pending_exception, Extract_exception(result));
 }
 
-CAMLprim value caml_glfwGetTime(CAMLvoid)
+CAMLprim value caml_glfwPollEvents(CAMLvoid)
 {
-    double time = glfwGetTime();
+    uint64_t probe_start = probe_begin();
+
+    run_main_thread_commands();
+    wakeup_drain();
+    glfwPollEvents();
+    flush_all_coalesced_events();
+    animated_cursors_tick();
+    probe_end(ProbePollEvents, probe_start);
+    raise_if_callback_failed();
     raise_if_error();
-    return caml_copy_double(time);
+    return Val_unit;
 }
 
-CAMLprim value caml_glfwSetTime(value time)
+CAMLprim value caml_glfwWaitEvents(CAMLvoid)
 {
-    glfwSetTime(Double_val(time));
+    uint64_t probe_start = probe_begin();
+
+    run_main_thread_commands();
+    release_runtime();
+    glfwWaitEvents();
+    acquire_runtime();
+    run_main_thread_commands();
+    probe_end(ProbeWaitEvents, probe_start);
+    flush_all_coalesced_events();
+    animated_cursors_tick();
+    raise_if_callback_failed();
     raise_if_error();
     return Val_unit;
 }
 
-CAMLprim value caml_glfwGetTimerValue(CAMLvoid)
+CAMLprim value caml_glfwWaitEventsTimeout(double timeout)
 {
-    uint64_t timer_value = glfwGetTimerValue();
+    uint64_t probe_start = probe_begin();
+
+    run_main_thread_commands();
+    release_runtime();
+    glfwWaitEventsTimeout(timeout);
+    acquire_runtime();
+    run_main_thread_commands();
+    probe_end(ProbeWaitEventsTimeout, probe_start);
+    flush_all_coalesced_events();
+    animated_cursors_tick();
+    raise_if_callback_failed();
     raise_if_error();
-    return caml_copy_int64(timer_value);
+    return Val_unit;
 }
 
-CAMLprim value caml_glfwGetTimerFrequency(CAMLvoid)
+CAMLprim value caml_glfwWaitEventsTimeout_byte(value timeout)
 {
-    uint64_t timer_frequency = glfwGetTimerFrequency();
-    raise_if_error();
-    return caml_copy_int64(timer_frequency);
+    return caml_glfwWaitEventsTimeout(Double_val(timeout));
 }
 
-CAMLprim value caml_glfwMakeContextCurrent(value window)
+CAMLprim value caml_glfwPostEmptyEvent(CAMLvoid)
 {
-    glfwMakeContextCurrent(
-        Is_none(window) ? NULL : Cptr_val(GLFWwindow*, Some_val(window)));
+    uint64_t probe_start = probe_begin();
+
+    glfwPostEmptyEvent();
+    probe_end(ProbePostEmptyEvent, probe_start);
+    wakeup_notify();
     raise_if_error();
     return Val_unit;
 }
 
-CAMLprim value caml_glfwGetCurrentContext(CAMLvoid)
+CAMLprim value caml_glfwGetInputMode(value window, value mode)
 {
-    GLFWwindow* window = glfwGetCurrentContext();
+    int v = glfwGetInputMode(Cptr_val(GLFWwindow*, window),
+                             Int_val(mode) + GLFW_CURSOR);
 
     raise_if_error();
-    return window == NULL ? Val_none : caml_alloc_some(Val_cptr(window));
+    if (Int_val(mode) == 0)
+        return Val_int(v - GLFW_CURSOR_NORMAL);
+    return Val_bool(v);
 }
 
-CAMLprim value caml_glfwSwapBuffers(value window)
+CAMLprim value caml_glfwSetInputMode(value window, value mode, value v)
 {
-    glfwSwapBuffers(Cptr_val(GLFWwindow*, window));
+    int glfw_val =
+        Int_val(mode) == 0 ? Int_val(v) + GLFW_CURSOR_NORMAL : Bool_val(v);
+
+    glfwSetInputMode(
+        Cptr_val(GLFWwindow*, window), Int_val(mode) + GLFW_CURSOR, glfw_val);
     raise_if_error();
     return Val_unit;
 }
 
-CAMLprim value caml_glfwSwapInterval(value interval)
+CAMLprim value caml_glfwRawMouseMotionSupported(CAMLvoid)
 {
-    glfwSwapInterval(Int_val(interval));
+    const int ret = glfwRawMouseMotionSupported();
     raise_if_error();
-    return Val_unit;
+    return Val_bool(ret);
 }
 
-CAMLprim value caml_glfwExtensionSupported(value extension)
+CAMLprim value caml_glfwGetKeyName(value key, value scancode)
 {
-    int result = glfwExtensionSupported(String_val(extension));
+    const char* name =
+        glfwGetKeyName(ml_to_glfw_key[Int_val(key)], Int_val(scancode));
+
     raise_if_error();
-    return Val_bool(result);
+    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+}
+
+CAMLprim value caml_glfwGetKeyScancode(value key)
+{
+    int ret = glfwGetKeyScancode(ml_to_glfw_key[Int_val(key)]);
+    raise_if_error();
+    return Val_int(ret);
+}
+
+CAMLprim value caml_glfwUncheckedGetKey(value window, value key)
+{
+    int ret =
+        glfwGetKey(Cptr_val(GLFWwindow*, window), ml_to_glfw_key[Int_val(key)]);
+    return Val_bool(ret);
+}
+
+CAML_CHECKED_STUB2(GetKey)
+
+CAMLprim value caml_glfwUncheckedGetMouseButton(value window, value button)
+{
+    int ret =
+        glfwGetMouseButton(Cptr_val(GLFWwindow*, window), Int_val(button));
+    return Val_bool(ret);
+}
+
+CAML_CHECKED_STUB2(GetMouseButton)
+
+CAMLprim value caml_glfwGetCursorPos(value window)
+{
+    CAMLparam0();
+    CAMLlocal3(ml_xpos, ml_ypos, ret);
+    double xpos, ypos;
+
+    glfwGetCursorPos(Cptr_val(GLFWwindow*, window), &xpos, &ypos);
+    raise_if_error();
+    ml_xpos = caml_copy_double(xpos);
+    ml_ypos = caml_copy_double(ypos);
+    ret = caml_alloc_small(2, 0);
+    Field(ret, 0) = ml_xpos;
+    Field(ret, 1) = ml_ypos;
+    CAMLreturn(ret);
+}
+
+CAMLprim double caml_glfwGetCursorX(value window)
+{
+    double xpos;
+
+    glfwGetCursorPos(Cptr_val(GLFWwindow*, window), &xpos, NULL);
+    raise_if_error();
+    return xpos;
+}
+
+CAMLprim value caml_glfwGetCursorX_byte(value window)
+{
+    return caml_copy_double(caml_glfwGetCursorX(window));
+}
+
+CAMLprim double caml_glfwGetCursorY(value window)
+{
+    double ypos;
+
+    glfwGetCursorPos(Cptr_val(GLFWwindow*, window), NULL, &ypos);
+    raise_if_error();
+    return ypos;
+}
+
+CAMLprim value caml_glfwGetCursorY_byte(value window)
+{
+    return caml_copy_double(caml_glfwGetCursorY(window));
+}
+
+CAMLprim value caml_glfwSetCursorPos(value window, double xpos, double ypos)
+{
+    glfwSetCursorPos(Cptr_val(GLFWwindow*, window), xpos, ypos);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwSetCursorPos_byte(value window, value xpos, value ypos)
+{
+    return caml_glfwSetCursorPos(window, Double_val(xpos), Double_val(ypos));
+}
+
+#define ML_KEY_COUNT (sizeof(ml_to_glfw_key) / sizeof(*ml_to_glfw_key))
+
+CAMLprim value caml_glfwKeyCount(CAMLvoid)
+{
+    return Val_int(ML_KEY_COUNT);
+}
+
+/* Fills an InputSnapshot.t. Unknown, the first key, has no state and is
+   always released. */
+CAMLprim value caml_glfwSnapshotInput(value ml_window, value snapshot)
+{
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    unsigned char* keys = Bytes_val(Field(snapshot, 0));
+    unsigned char* buttons = Bytes_val(Field(snapshot, 1));
+    double* cursor = Caml_ba_data_val(Field(snapshot, 2));
+
+    keys[0] = 0;
+    for (unsigned int i = 1; i < ML_KEY_COUNT; ++i)
+        keys[i] = glfwGetKey(window, ml_to_glfw_key[i]) == GLFW_PRESS;
+    for (int i = 0; i <= GLFW_MOUSE_BUTTON_LAST; ++i)
+        buttons[i] = glfwGetMouseButton(window, i) == GLFW_PRESS;
+    glfwGetCursorPos(window, &cursor[0], &cursor[1]);
+    raise_if_error();
+    return Val_unit;
+}
+
+static value create_cursor(value image, value xhot, value yhot, int bigarray)
+{
+    GLFWimage glfw_image;
+    GLFWcursor* ret;
+
+    glfw_image.width = Int_val(Field(image, 0));
+    glfw_image.height = Int_val(Field(image, 1));
+    glfw_image.pixels = image_pixels(image, bigarray);
+    ret = glfwCreateCursor(&glfw_image, Int_val(xhot), Int_val(yhot));
+    raise_if_error();
+    return Val_cptr(ret);
+}
+
+CAMLprim value caml_glfwCreateCursor(value image, value xhot, value yhot)
+{
+    return create_cursor(image, xhot, yhot, 0);
+}
+
+CAMLprim value caml_glfwCreateCursorBigarray(
+    value image, value xhot, value yhot)
+{
+    return create_cursor(image, xhot, yhot, 1);
+}
+
+CAMLprim value caml_glfwCreateStandardCursor(value shape)
+{
+    GLFWcursor* ret =
+        glfwCreateStandardCursor(GLFW_ARROW_CURSOR + Int_val(shape));
+    raise_if_error();
+    return Val_cptr(ret);
+}
+
+CAMLprim value caml_glfwDestroyCursor(value cursor)
+{
+    glfwDestroyCursor(Cptr_val(GLFWcursor*, cursor));
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwSetCursor(value ml_window, value cursor)
+{
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+
+    glfwSetCursor(window, Cptr_val(GLFWcursor*, cursor));
+    raise_if_error();
+    if (window_states[window_id(window)].animated_cursor != NULL)
+    {
+        window_states[window_id(window)].animated_cursor = NULL;
+        --animated_window_count;
+    }
+    return Val_unit;
+}
+
+/* The following stubs may call two closures in a row and the first one may
+   trigger a garbage collection, so the callbacks are fetched again each
+   time. */
+void key_callback_stub(
+    GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    flush_window_events(window);
+    record_ints(EventKey, window, key, scancode, action, mods);
+    int released = callback_enter(ProbeKey);
+
+    value result = Val_unit;
+    value args[] = {
+        Val_cptr(window), Val_int(glfw_to_ml_key[key - GLFW_KEY_FIRST]),
+        Val_int(scancode), Val_int(action), Val_unit
+    };
+
+    if (window_callbacks(window)->key != Val_unit)
+    {
+        args[4] = caml_list_of_flags(mods, 4);
+        result = caml_callbackN_exn(
+            window_callbacks(window)->key, sizeof(args) / sizeof(*args), args);
+    }
+    if (!Is_exception_result(result)
+        && window_callbacks(window)->key_bits != Val_unit)
+    {
+        args[4] = Val_int(mods);
+        result = caml_callbackN_exn(window_callbacks(window)->key_bits,
+                                    sizeof(args) / sizeof(*args), args);
+    }
+    callback_leave(released, result);
+}
+
+CAML_WINDOW_SHARED_INSTALLER(glfwSetKeyCallback, key)
+CAML_WINDOW_SETTER_STUB(glfwSetKeyCallback, key)
+CAML_WINDOW_CALLBACK_SETTER(caml_glfwSetKeyBitsCallback, key_bits, install_key)
+
+void character_callback_stub(GLFWwindow* window, unsigned int codepoint)
+{
+    flush_window_events(window);
+    record_ints(EventChar, window, codepoint, 0, 0, 0);
+    int released = callback_enter(ProbeCharacter);
+
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    callback_leave(released, caml_callback2_exn(
+        ml_window_callbacks->character, Val_cptr(window), Val_int(codepoint)));
+}
+
+CAML_WINDOW_INSTALLER(glfwSetCharCallback, character)
+CAML_WINDOW_SETTER_STUB(glfwSetCharCallback, character)
+
+void character_mods_callback_stub(
+    GLFWwindow* window, unsigned int codepoint, int mods)
+{
+    flush_window_events(window);
+    record_ints(EventCharMods, window, codepoint, mods, 0, 0);
+    int released = callback_enter(ProbeCharacterMods);
+
+    value result = Val_unit;
+
+    if (window_callbacks(window)->character_mods != Val_unit)
+    {
+        value ml_mods = caml_list_of_flags(mods, 4);
+        result = caml_callback3_exn(window_callbacks(window)->character_mods,
+                                    Val_cptr(window), Val_int(codepoint),
+                                    ml_mods);
+    }
+    if (!Is_exception_result(result)
+        && window_callbacks(window)->character_mods_bits != Val_unit)
+        result = caml_callback3_exn(
+            window_callbacks(window)->character_mods_bits, Val_cptr(window),
+            Val_int(codepoint), Val_int(mods));
+    callback_leave(released, result);
+}
+
+CAML_WINDOW_SHARED_INSTALLER(glfwSetCharModsCallback, character_mods)
+CAML_WINDOW_SETTER_STUB(glfwSetCharModsCallback, character_mods)
+CAML_WINDOW_CALLBACK_SETTER(caml_glfwSetCharModsBitsCallback,
+                            character_mods_bits, install_character_mods)
+
+void mouse_button_callback_stub(
+    GLFWwindow* window, int button, int action, int mods)
+{
+    flush_window_events(window);
+    record_ints(EventMouseButton, window, button, action, mods, 0);
+    int released = callback_enter(ProbeMouseButton);
+
+    value result = Val_unit;
+    value args[] = {
+        Val_cptr(window), Val_int(button), Val_bool(action), Val_unit
+    };
+
+    if (window_callbacks(window)->mouse_button != Val_unit)
+    {
+        args[3] = caml_list_of_flags(mods, 4);
+        result = caml_callbackN_exn(window_callbacks(window)->mouse_button,
+                                    sizeof(args) / sizeof(*args), args);
+    }
+    if (!Is_exception_result(result)
+        && window_callbacks(window)->mouse_button_bits != Val_unit)
+    {
+        args[3] = Val_int(mods);
+        result = caml_callbackN_exn(
+            window_callbacks(window)->mouse_button_bits,
+            sizeof(args) / sizeof(*args), args);
+    }
+    callback_leave(released, result);
+}
+
+CAML_WINDOW_SHARED_INSTALLER(glfwSetMouseButtonCallback, mouse_button)
+CAML_WINDOW_SETTER_STUB(glfwSetMouseButtonCallback, mouse_button)
+CAML_WINDOW_CALLBACK_SETTER(caml_glfwSetMouseButtonBitsCallback,
+                            mouse_button_bits, install_mouse_button)
+
+void cursor_pos_callback_stub(GLFWwindow* window, double xpos, double ypos)
+{
+    record_floats(EventCursorPos, window, xpos, ypos);
+    int released = callback_enter(ProbeCursorPos);
+
+    CAMLparam0();
+    CAMLlocal2(ml_xpos, ml_ypos);
+    value result;
+
+    ml_xpos = caml_copy_double(xpos);
+    ml_ypos = caml_copy_double(ypos);
+    result = caml_callback3_exn(window_callbacks(window)->cursor_pos,
+                                Val_cptr(window), ml_xpos, ml_ypos);
+    CAMLdrop;
+    callback_leave(released, result);
+}
+
+CAML_WINDOW_COALESCING_INSTALLER(glfwSetCursorPosCallback, cursor_pos)
+CAML_WINDOW_SETTER_STUB(glfwSetCursorPosCallback, cursor_pos)
+
+void cursor_enter_callback_stub(GLFWwindow* window, int entered)
+{
+    flush_window_events(window);
+    record_ints(EventCursorEnter, window, entered, 0, 0, 0);
+    int released = callback_enter(ProbeCursorEnter);
+
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    callback_leave(released, caml_callback2_exn(
+        ml_window_callbacks->cursor_enter, Val_cptr(window),
+        Val_bool(entered)));
+}
+
+CAML_WINDOW_INSTALLER(glfwSetCursorEnterCallback, cursor_enter)
+CAML_WINDOW_SETTER_STUB(glfwSetCursorEnterCallback, cursor_enter)
+
+void scroll_callback_stub(GLFWwindow* window, double xoffset, double yoffset)
+{
+    record_floats(EventScroll, window, xoffset, yoffset);
+    int released = callback_enter(ProbeScroll);
+
+    CAMLparam0();
+    CAMLlocal2(ml_xoffset, ml_yoffset);
+    value result;
+
+    ml_xoffset = caml_copy_double(xoffset);
+    ml_yoffset = caml_copy_double(yoffset);
+    result = caml_callback3_exn(window_callbacks(window)->scroll,
+                                Val_cptr(window), ml_xoffset, ml_yoffset);
+    CAMLdrop;
+    callback_leave(released, result);
+}
+
+CAML_WINDOW_COALESCING_INSTALLER(glfwSetScrollCallback, scroll)
+CAML_WINDOW_SETTER_STUB(glfwSetScrollCallback, scroll)
+
+/* Paths of the drop being dispatched to a DropPaths callback. A DropPaths.t
+   only holds the serial number of its drop, so that using it after the
+   callback returned is detected. */
+static const char** drop_paths = NULL;
+static int drop_count = 0;
+static uintnat drop_serial = 0;
+
+void drop_callback_stub(GLFWwindow* window, int count, const char** paths)
+{
+    flush_window_events(window);
+    record_drop(window, count, paths);
+    int released = callback_enter(ProbeDrop);
+
+    CAMLparam0();
+    CAMLlocal2(ml_paths, str);
+    value result = Val_unit;
+    int i = count;
+
+    if (window_callbacks(window)->drop != Val_unit)
+    {
+        ml_paths = Val_emptylist;
+        while (i > 0)
+        {
+            str = caml_copy_string(paths[--i]);
+            value tmp = caml_alloc_small(2, 0);
+            Field(tmp, 0) = str;
+            Field(tmp, 1) = ml_paths;
+            ml_paths = tmp;
+        }
+        result = caml_callback2_exn(
+            window_callbacks(window)->drop, Val_cptr(window), ml_paths);
+    }
+    if (!Is_exception_result(result)
+        && window_callbacks(window)->drop_paths != Val_unit)
+    {
+        drop_paths = paths;
+        drop_count = count;
+        result = caml_callback2_exn(window_callbacks(window)->drop_paths,
+                                    Val_cptr(window), Val_long(++drop_serial));
+        drop_paths = NULL;
+        drop_count = 0;
+    }
+    CAMLdrop;
+    callback_leave(released, result);
+}
+
+/* Dropped paths do not fit in the event queue; drop callbacks are always
+   dispatched to their closure. */
+static void install_drop(
+    GLFWwindow* window, struct ml_window_callbacks* callbacks)
+{
+    glfwSetDropCallback(window, callbacks->drop == Val_unit
+                        && callbacks->drop_paths == Val_unit
+                        ? NULL : drop_callback_stub);
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetDropCallback, drop)
+CAML_WINDOW_CALLBACK_SETTER(caml_glfwSetDropPathsCallback,
+                            drop_paths, install_drop)
+
+static inline void check_drop_paths(value ml_paths, const char* message)
+{
+    if (drop_paths == NULL || (uintnat)Long_val(ml_paths) != drop_serial)
+        caml_invalid_argument(message);
+}
+
+CAMLprim value caml_glfwDropPathsLength(value ml_paths)
+{
+    check_drop_paths(ml_paths, "DropPaths.length: callback has returned.");
+    return Val_int(drop_count);
+}
+
+CAMLprim value caml_glfwDropPathsGet(value ml_paths, value index)
+{
+    check_drop_paths(ml_paths, "DropPaths.get: callback has returned.");
+    if (Long_val(index) < 0 || Long_val(index) >= drop_count)
+        caml_invalid_argument("DropPaths.get: index out of bounds.");
+    return caml_copy_string(drop_paths[Long_val(index)]);
+}
+
+/* Copy of the paths of a drop outliving its callback, in one allocation:
+   the array of pointers is followed by the strings themselves. */
+struct detached_paths
+{
+    int count;
+    const char* paths[];
+};
+
+#define Detached_paths_val(v) Cptr_val(struct detached_paths*, v)
+
+CAMLprim value caml_glfwDropPathsDetach(value ml_paths)
+{
+    struct detached_paths* detached;
+    size_t size = 0;
+    char* data;
+    int i;
+
+    check_drop_paths(ml_paths, "DropPaths.detach: callback has returned.");
+    for (i = 0; i < drop_count; ++i)
+        size += strlen(drop_paths[i]) + 1;
+    detached = malloc(sizeof(*detached)
+                      + drop_count * sizeof(*detached->paths) + size);
+    if (detached == NULL)
+        caml_raise_out_of_memory();
+    detached->count = drop_count;
+    data = (char*)(detached->paths + drop_count);
+    for (i = 0; i < drop_count; ++i)
+    {
+        size = strlen(drop_paths[i]) + 1;
+        memcpy(data, drop_paths[i], size);
+        detached->paths[i] = data;
+        data += size;
+    }
+    return Val_cptr(detached);
+}
+
+CAMLprim value caml_glfwDetachedPathsLength(value detached)
+{
+    return Val_int(Detached_paths_val(detached)->count);
+}
+
+CAMLprim value caml_glfwDetachedPathsGet(value ml_detached, value index)
+{
+    struct detached_paths* detached = Detached_paths_val(ml_detached);
+
+    if (Long_val(index) < 0 || Long_val(index) >= detached->count)
+        caml_invalid_argument("DropPaths.Detached.get: index out of bounds.");
+    return caml_copy_string(detached->paths[Long_val(index)]);
+}
+
+CAMLprim value caml_glfwDetachedPathsDestroy(value detached)
+{
+    free(Detached_paths_val(detached));
+    return Val_unit;
+}
+
+static void install_queueable_callbacks(GLFWwindow* window)
+{
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    install_window_pos(window, ml_window_callbacks);
+    install_window_size(window, ml_window_callbacks);
+    install_window_close(window, ml_window_callbacks);
+    install_window_refresh(window, ml_window_callbacks);
+    install_window_focus(window, ml_window_callbacks);
+    install_window_iconify(window, ml_window_callbacks);
+    install_window_maximize(window, ml_window_callbacks);
+    install_framebuffer_size(window, ml_window_callbacks);
+    install_window_content_scale(window, ml_window_callbacks);
+    install_key(window, ml_window_callbacks);
+    install_character(window, ml_window_callbacks);
+    install_character_mods(window, ml_window_callbacks);
+    install_mouse_button(window, ml_window_callbacks);
+    install_cursor_pos(window, ml_window_callbacks);
+    install_cursor_enter(window, ml_window_callbacks);
+    install_scroll(window, ml_window_callbacks);
+}
+
+static void event_queue_resize(unsigned int capacity)
+{
+    struct ml_event* new_queue = malloc(sizeof(*new_queue) * capacity);
+
+    if (new_queue == NULL)
+        caml_raise_out_of_memory();
+    free(event_queue);
+    event_queue = new_queue;
+    event_queue_capacity = capacity;
+    event_queue_head = 0;
+    event_queue_length = 0;
+}
+
+CAMLprim value caml_glfwSetEventCoalescing(value ml_window, value enabled)
+{
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    uintnat id = window_id(window);
+
+    raise_if_error();
+    if (!Bool_val(enabled))
+        flush_coalesced_events(id);
+    window_states[id].coalescing = Bool_val(enabled);
+    install_cursor_pos(window, window_callbacks(window));
+    install_scroll(window, window_callbacks(window));
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwEventQueueSetCapacity(value capacity)
+{
+    event_queue_resize(Long_val(capacity));
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwEventQueueAttach(value ml_window)
+{
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    raise_if_error();
+    if (event_queue == NULL)
+        event_queue_resize(EVENT_QUEUE_DEFAULT_CAPACITY);
+    ml_window_callbacks->queued = Val_true;
+    install_queueable_callbacks(window);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwEventQueueDetach(value ml_window)
+{
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    struct ml_window_callbacks* ml_window_callbacks = window_callbacks(window);
+
+    raise_if_error();
+    ml_window_callbacks->queued = Val_false;
+    install_queueable_callbacks(window);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwEventQueueLength(CAMLvoid)
+{
+    return Val_int(event_queue_length);
+}
+
+/* Removes the count oldest events, events overwritten in the meantime
+   counting as removed. */
+CAMLprim value caml_glfwEventQueueDiscard(value count, value dropped)
+{
+    intnat discarded = Long_val(count)
+        - (intnat)(event_queue_dropped - Long_val(dropped));
+
+    if (discarded <= 0)
+        return Val_unit;
+    if ((uintnat)discarded > event_queue_length)
+        discarded = event_queue_length;
+    event_queue_head = (event_queue_head + discarded) % event_queue_capacity;
+    event_queue_length -= discarded;
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwEventQueueDropped(CAMLvoid)
+{
+    return Val_long(event_queue_dropped);
+}
+
+CAMLprim value caml_glfwEventQueueClear(CAMLvoid)
+{
+    event_queue_head = 0;
+    event_queue_length = 0;
+    event_queue_dropped = 0;
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwEventQueueKind(value index)
+{
+    return Val_int(event_queue_get(index)->kind);
+}
+
+CAMLprim value caml_glfwEventQueueWindow(value index)
+{
+    return Val_cptr(event_queue_get(index)->window);
+}
+
+CAMLprim value caml_glfwEventQueueIntArg(value index, value arg)
+{
+    return Val_int(event_queue_get(index)->ints[Int_val(arg)]);
+}
+
+CAMLprim double caml_glfwEventQueueFloatArg(value index, value arg)
+{
+    return event_queue_get(index)->floats[Int_val(arg)];
+}
+
+CAMLprim value caml_glfwEventQueueFloatArg_byte(value index, value arg)
+{
+    return caml_copy_double(caml_glfwEventQueueFloatArg(index, arg));
+}
+
+CAMLprim value caml_glfwUncheckedJoystickPresent(value joy)
+{
+    int ret = glfwJoystickPresent(Int_val(joy));
+    return Val_bool(ret);
+}
+
+CAML_CHECKED_STUB1(JoystickPresent)
+
+CAMLprim value caml_glfwGetJoystickAxes(value joy)
+{
+    value ret;
+    int count;
+    uint64_t probe_start = probe_begin();
+    const float* axes = glfwGetJoystickAxes(Int_val(joy), &count);
+
+    probe_end(ProbeGetJoystickAxes, probe_start);
+    raise_if_error();
+    ret = caml_alloc_float_array(count);
+    for (int i = 0; i < count; ++i)
+        Store_double_field(ret, i, axes[i]);
+    return ret;
+}
+
+CAMLprim value caml_glfwGetJoystickButtons(value joy)
+{
+    value ret;
+    int count;
+    const unsigned char* buttons = glfwGetJoystickButtons(Int_val(joy), &count);
+
+    raise_if_error();
+    if (count == 0)
+        return Atom(0);
+    ret = caml_alloc_small(count, 0);
+    for (int i = 0; i < count; ++i)
+        Field(ret, i) = Val_bool(buttons[i] == GLFW_PRESS);
+    return ret;
+}
+
+CAMLprim value caml_glfwGetJoystickHats(value joy)
+{
+    CAMLparam0();
+    CAMLlocal1(ret);
+    int count;
+    const unsigned char* hats = glfwGetJoystickHats(Int_val(joy), &count);
+
+    raise_if_error();
+    if (count == 0)
+        ret = Atom(0);
+    else
+    {
+        ret = caml_alloc_small(count, 0);
+        for (int i = 0; i < count; ++i)
+            Field(ret, i) = Val_unit;
+        for (int i = 0; i < count; ++i)
+            Store_field(ret, i, caml_list_of_flags(hats[i], 4));
+    }
+    CAMLreturn(ret);
+}
+
+CAMLprim value caml_glfwGetJoystickHatsBits(value joy)
+{
+    value ret;
+    int count;
+    const unsigned char* hats = glfwGetJoystickHats(Int_val(joy), &count);
+
+    raise_if_error();
+    if (count == 0)
+        return Atom(0);
+    ret = caml_alloc_small(count, 0);
+    for (int i = 0; i < count; ++i)
+        Field(ret, i) = Val_int(hats[i]);
+    return ret;
+}
+
+static inline intnat min_count(int count, intnat dim)
+{
+    return count < dim ? count : dim;
+}
+
+CAMLprim value caml_glfwUncheckedGetJoystickAxesInto(value joy, value ml_axes)
+{
+    int count;
+    const float* axes = glfwGetJoystickAxes(Int_val(joy), &count);
+    intnat written = min_count(count, Caml_ba_array_val(ml_axes)->dim[0]);
+
+    if (written > 0)
+        memcpy(Caml_ba_data_val(ml_axes), axes, written * sizeof(*axes));
+    return Val_long(written);
+}
+
+CAML_CHECKED_STUB2(GetJoystickAxesInto)
+
+CAMLprim value caml_glfwUncheckedGetJoystickButtonsInto(
+    value joy, value ml_buttons)
+{
+    int count;
+    const unsigned char* buttons = glfwGetJoystickButtons(Int_val(joy), &count);
+    intnat written = min_count(count, Caml_ba_array_val(ml_buttons)->dim[0]);
+
+    if (written > 0)
+        memcpy(Caml_ba_data_val(ml_buttons), buttons, written);
+    return Val_long(written);
+}
+
+CAML_CHECKED_STUB2(GetJoystickButtonsInto)
+
+CAMLprim value caml_glfwUncheckedGetJoystickHatsInto(value joy, value ml_hats)
+{
+    int count;
+    const unsigned char* hats = glfwGetJoystickHats(Int_val(joy), &count);
+    intnat written = min_count(count, Caml_ba_array_val(ml_hats)->dim[0]);
+
+    if (written > 0)
+        memcpy(Caml_ba_data_val(ml_hats), hats, written);
+    return Val_long(written);
+}
+
+CAML_CHECKED_STUB2(GetJoystickHatsInto)
+
+/* Copies the axes, buttons and hats of every joystick into the rows of the
+   matrices of a JoystickRack.t in one sweep. Row i of the counts matrix
+   holds the number of axes, buttons and hats written for joystick i, all
+   zero when it is not present. */
+CAMLprim value caml_glfwPollJoysticks(value rack)
+{
+    struct caml_ba_array* ml_axes = Caml_ba_array_val(Field(rack, 0));
+    struct caml_ba_array* ml_buttons = Caml_ba_array_val(Field(rack, 1));
+    struct caml_ba_array* ml_hats = Caml_ba_array_val(Field(rack, 2));
+    intnat* counts = Caml_ba_data_val(Field(rack, 3));
+    int present = 0;
+
+    for (int joy = 0; joy <= GLFW_JOYSTICK_LAST; ++joy)
+    {
+        int axes_count = 0, buttons_count = 0, hats_count = 0;
+        const float* axes = glfwGetJoystickAxes(joy, &axes_count);
+        const unsigned char* buttons =
+            glfwGetJoystickButtons(joy, &buttons_count);
+        const unsigned char* hats = glfwGetJoystickHats(joy, &hats_count);
+        intnat* row = counts + 3 * joy;
+
+        if (axes == NULL)
+        {
+            row[0] = row[1] = row[2] = 0;
+            continue;
+        }
+        present |= 1 << joy;
+        row[0] = min_count(axes_count, ml_axes->dim[1]);
+        row[1] = min_count(buttons_count, ml_buttons->dim[1]);
+        row[2] = min_count(hats_count, ml_hats->dim[1]);
+        memcpy((float*)ml_axes->data + joy * ml_axes->dim[1], axes,
+               row[0] * sizeof(*axes));
+        memcpy((unsigned char*)ml_buttons->data + joy * ml_buttons->dim[1],
+               buttons, row[1]);
+        memcpy((unsigned char*)ml_hats->data + joy * ml_hats->dim[1],
+               hats, row[2]);
+    }
+    raise_if_error();
+    return Val_int(present);
+}
+
+CAMLprim value caml_glfwGetJoystickGUID(value joy)
+{
+    const char* name = glfwGetJoystickGUID(Int_val(joy));
+
+    raise_if_error();
+    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+}
+
+CAMLprim value caml_glfwGetJoystickName(value joy)
+{
+    const char* name = glfwGetJoystickName(Int_val(joy));
+
+    raise_if_error();
+    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+}
+
+CAMLprim value caml_glfwUncheckedJoystickIsGamepad(value joy)
+{
+    int ret = glfwJoystickIsGamepad(Int_val(joy));
+    return Val_bool(ret);
+}
+
+CAML_CHECKED_STUB1(JoystickIsGamepad)
+
+static value joystick_closure = Val_unit;
+
+void joystick_callback_stub(int joy, int event)
+{
+    record_device(RecordJoystick, joy, event);
+    int released = callback_enter(ProbeJoystick);
+    callback_leave(released, caml_callback2_exn(
+        joystick_closure, Val_int(joy), Val_int(event - GLFW_DISCONNECTED)));
+}
+
+CAML_SETTER_STUB(glfwSetJoystickCallback, joystick)
+
+CAMLprim value caml_glfwUpdateGamepadMappings(value string)
+{
+    glfwUpdateGamepadMappings(String_val(string));
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwGetGamepadName(value joy)
+{
+    const char* name = glfwGetGamepadName(Int_val(joy));
+
+    raise_if_error();
+    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+}
+
+CAMLprim value caml_glfwGetGamepadState(value joy)
+{
+    CAMLparam0();
+    CAMLlocal3(buttons, axes, ret);
+    GLFWgamepadstate gamepad_state;
+    uint64_t probe_start = probe_begin();
+
+    glfwGetGamepadState(Int_val(joy), &gamepad_state);
+    probe_end(ProbeGetGamepadState, probe_start);
+    raise_if_error();
+    buttons = caml_alloc_small(15, 0);
+    for (unsigned int i = 0; i < 15; ++i)
+        Field(buttons, i) = Val_bool(gamepad_state.buttons[i] == GLFW_PRESS);
+    axes = caml_alloc_float_array(6);
+    for (unsigned int i = 0; i < 6; ++i)
+        Store_double_field(axes, i, gamepad_state.axes[i]);
+    ret = caml_alloc_small(2, 0);
+    Field(ret, 0) = buttons;
+    Field(ret, 1) = axes;
+    CAMLreturn(ret);
+}
+
+CAMLprim value caml_glfwUncheckedGetGamepadStateInto(
+    value joy, value ml_buttons, value ml_axes)
+{
+    GLFWgamepadstate gamepad_state;
+    int ret = glfwGetGamepadState(Int_val(joy), &gamepad_state);
+
+    if (ret)
+    {
+        intnat buttons = min_count(sizeof(gamepad_state.buttons),
+                                   Caml_ba_array_val(ml_buttons)->dim[0]);
+        intnat axes = min_count(sizeof(gamepad_state.axes)
+                                / sizeof(*gamepad_state.axes),
+                                Caml_ba_array_val(ml_axes)->dim[0]);
+
+        memcpy(Caml_ba_data_val(ml_buttons), gamepad_state.buttons, buttons);
+        memcpy(Caml_ba_data_val(ml_axes), gamepad_state.axes,
+               axes * sizeof(*gamepad_state.axes));
+    }
+    return Val_bool(ret);
+}
+
+CAML_CHECKED_STUB3(GetGamepadStateInto)
+
+CAMLprim value caml_glfwSetClipboardString(CAMLvoid, value string)
+{
+    uint64_t probe_start = probe_begin();
+
+    clipboard_contents = NULL;
+    glfwSetClipboardString(NULL, String_val(string));
+    probe_end(ProbeSetClipboardString, probe_start);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwGetClipboardString(CAMLvoid)
+{
+    uint64_t probe_start = probe_begin();
+
+    clipboard_contents = NULL;
+    const char* string = glfwGetClipboardString(NULL);
+    probe_end(ProbeGetClipboardString, probe_start);
+    raise_if_error();
+    return caml_copy_string(string);
+}
+
+CAMLprim value caml_glfwClipboardFetch(CAMLvoid)
+{
+    clipboard_contents = NULL;
+    const char* string = glfwGetClipboardString(NULL);
+    raise_if_error();
+    clipboard_contents = string == NULL ? "" : string;
+    clipboard_length = strlen(clipboard_contents);
+    return Val_long(clipboard_length);
+}
+
+CAMLprim value caml_glfwClipboardBlit(
+    value src_pos, value dst, value dst_pos, value len)
+{
+    intnat src = Long_val(src_pos), pos = Long_val(dst_pos), n = Long_val(len);
+
+    if (clipboard_contents == NULL)
+        caml_invalid_argument("Clipboard.blit: nothing fetched.");
+    if (src < 0 || pos < 0 || n < 0 || src > (intnat)clipboard_length - n
+        || pos > Caml_ba_array_val(dst)->dim[0] - n)
+        caml_invalid_argument("Clipboard.blit: out of bounds.");
+    memcpy((char*)Caml_ba_data_val(dst) + pos, clipboard_contents + src, n);
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwClipboardSet(value buffer, value len)
+{
+    const char* data = Caml_ba_data_val(buffer);
+    intnat n = Long_val(len);
+    char* copy = NULL;
+
+    if (n < 0 || n > Caml_ba_array_val(buffer)->dim[0])
+        caml_invalid_argument("Clipboard.set: out of bounds.");
+    /* GLFW expects a NUL-terminated string, copy the data unless the buffer
+       already has one right after it. */
+    if (n == Caml_ba_array_val(buffer)->dim[0] || data[n] != '\0')
+    {
+        copy = malloc(n + 1);
+        if (copy == NULL)
+            caml_raise_out_of_memory();
+        memcpy(copy, data, n);
+        copy[n] = '\0';
+        data = copy;
+    }
+    clipboard_contents = NULL;
+    glfwSetClipboardString(NULL, data);
+    free(copy);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim double caml_glfwGetTime(CAMLvoid)
+{
+    double time = glfwGetTime();
+    raise_if_error();
+    return time;
+}
+
+CAMLprim value caml_glfwGetTime_byte(value unit)
+{
+    return caml_copy_double(caml_glfwGetTime(unit));
+}
+
+CAMLprim value caml_glfwSetTime(double time)
+{
+    glfwSetTime(time);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwSetTime_byte(value time)
+{
+    return caml_glfwSetTime(Double_val(time));
+}
+
+CAMLprim int64_t caml_glfwGetTimerValue(CAMLvoid)
+{
+    uint64_t timer_value = glfwGetTimerValue();
+    raise_if_error();
+    return timer_value;
+}
+
+CAMLprim value caml_glfwGetTimerValue_byte(value unit)
+{
+    return caml_copy_int64(caml_glfwGetTimerValue(unit));
+}
+
+CAMLprim int64_t caml_glfwGetTimerFrequency(CAMLvoid)
+{
+    uint64_t timer_frequency = glfwGetTimerFrequency();
+    raise_if_error();
+    return timer_frequency;
+}
+
+CAMLprim value caml_glfwGetTimerFrequency_byte(value unit)
+{
+    return caml_copy_int64(caml_glfwGetTimerFrequency(unit));
+}
+
+CAMLprim value caml_glfwMakeContextCurrent(value window)
+{
+    uint64_t probe_start = probe_begin();
+
+    glfwMakeContextCurrent(
+        Is_none(window) ? NULL : Cptr_val(GLFWwindow*, Some_val(window)));
+    probe_end(ProbeMakeContextCurrent, probe_start);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwGetCurrentContext(CAMLvoid)
+{
+    GLFWwindow* window = glfwGetCurrentContext();
+
+    raise_if_error();
+    return window == NULL ? Val_none : caml_alloc_some(Val_cptr(window));
+}
+
+/* Swapping buffers does not trigger any callback so it can release the
+   runtime lock without setting runtime_released. This allows it to be called
+   from any thread holding a context. */
+CAMLprim value caml_glfwSwapBuffers(value window)
+{
+    GLFWwindow* glfw_window = Cptr_val(GLFWwindow*, window);
+    uint64_t probe_start = probe_begin();
+
+    caml_enter_blocking_section();
+    glfwSwapBuffers(glfw_window);
+    caml_leave_blocking_section();
+    probe_end(ProbeSwapBuffers, probe_start);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwSwapInterval(value interval)
+{
+    uint64_t probe_start = probe_begin();
+
+    glfwSwapInterval(Int_val(interval));
+    probe_end(ProbeSwapInterval, probe_start);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwExtensionSupported(value extension)
+{
+    int result = glfwExtensionSupported(String_val(extension));
+    raise_if_error();
+    return Val_bool(result);
+}
+
+/* GLFW only declares the functions taking Vulkan handles when the Vulkan
+   header was included beforehand. Handles are exchanged with OCaml as
+   integers, so rather than depending on the Vulkan SDK we declare the few
+   types these functions need ourselves, with the same layout. */
+#ifndef VK_VERSION_1_0
+typedef struct VkInstance_T* VkInstance;
+typedef struct VkPhysicalDevice_T* VkPhysicalDevice;
+# if UINTPTR_MAX == UINT64_MAX
+typedef struct VkSurfaceKHR_T* VkSurfaceKHR;
+# else
+typedef uint64_t VkSurfaceKHR;
+# endif
+typedef int VkResult;
+typedef struct VkAllocationCallbacks VkAllocationCallbacks;
+
+GLFWAPI int glfwGetPhysicalDevicePresentationSupport(
+    VkInstance instance, VkPhysicalDevice device, uint32_t queuefamily);
+GLFWAPI VkResult glfwCreateWindowSurface(
+    VkInstance instance, GLFWwindow* window,
+    const VkAllocationCallbacks* allocator, VkSurfaceKHR* surface);
+#endif
+
+CAMLprim value caml_glfwVulkanSupported(CAMLvoid)
+{
+    int ret = glfwVulkanSupported();
+    raise_if_error();
+    return Val_bool(ret);
+}
+
+CAMLprim value caml_glfwGetRequiredInstanceExtensions(CAMLvoid)
+{
+    CAMLparam0();
+    CAMLlocal2(ret, extension);
+    uint32_t count;
+    const char** extensions = glfwGetRequiredInstanceExtensions(&count);
+
+    raise_if_error();
+    ret = Val_emptylist;
+    while (extensions != NULL && count > 0)
+    {
+        value tmp;
+        extension = caml_copy_string(extensions[--count]);
+        tmp = caml_alloc_small(2, 0);
+        Field(tmp, 0) = extension;
+        Field(tmp, 1) = ret;
+        ret = tmp;
+    }
+    CAMLreturn(ret);
+}
+
+CAMLprim value caml_glfwGetPhysicalDevicePresentationSupport(
+    intnat instance, intnat device, value queue_family)
+{
+    int ret = glfwGetPhysicalDevicePresentationSupport(
+        (VkInstance)instance, (VkPhysicalDevice)device,
+        Int_val(queue_family));
+    raise_if_error();
+    return Val_bool(ret);
+}
+
+CAMLprim value caml_glfwGetPhysicalDevicePresentationSupport_byte(
+    value instance, value device, value queue_family)
+{
+    return caml_glfwGetPhysicalDevicePresentationSupport(
+        Nativeint_val(instance), Nativeint_val(device), queue_family);
+}
+
+CAMLprim int64_t caml_glfwCreateWindowSurface(intnat instance, value window)
+{
+    VkSurfaceKHR surface = 0;
+    char message[64];
+    VkResult result = glfwCreateWindowSurface(
+        (VkInstance)instance, Cptr_val(GLFWwindow*, window), NULL, &surface);
+
+    raise_if_error();
+    /* Not every Vulkan failure is also reported as a GLFW error. */
+    if (result != 0)
+    {
+        snprintf(message, sizeof(message),
+                 "createWindowSurface: VkResult %d.", (int)result);
+        caml_failwith(message);
+    }
+#if UINTPTR_MAX == UINT64_MAX
+    return (int64_t)(uintptr_t)surface;
+#else
+    return (int64_t)surface;
+#endif
+}
+
+CAMLprim value caml_glfwCreateWindowSurface_byte(value instance, value window)
+{
+    return caml_copy_int64(
+        caml_glfwCreateWindowSurface(Nativeint_val(instance), window));
+}
+
+/* Frame pacer. Frame times are measured with the GLFW timer and kept in a
+   ring buffer so that statistics can be computed without allocating. */
+struct frame_pacer
+{
+    uint64_t frequency;
+    uint64_t period;
+    uint64_t last_frame;
+    uint64_t deadline;
+    uintnat late_frames;
+    uintnat capacity;
+    uintnat head;
+    uintnat count;
+    double* history;
+    double* sorted;
+};
+
+#define Pacer_val(v) Cptr_val(struct frame_pacer*, v)
+
+static void frame_pacer_set_target(struct frame_pacer* pacer, double fps)
+{
+    pacer->period = fps > 0. ? (uint64_t)(pacer->frequency / fps) : 0;
+    pacer->deadline = pacer->last_frame + pacer->period;
+}
+
+CAMLprim value caml_glfwFramePacerCreate(double fps, value history)
+{
+    struct frame_pacer* pacer = malloc(sizeof(*pacer));
+    uintnat capacity = Long_val(history);
+
+    if (pacer == NULL)
+        caml_raise_out_of_memory();
+    pacer->history = malloc(capacity * sizeof(*pacer->history));
+    pacer->sorted = malloc(capacity * sizeof(*pacer->sorted));
+    if (pacer->history == NULL || pacer->sorted == NULL)
+    {
+        free(pacer->history);
+        free(pacer->sorted);
+        free(pacer);
+        caml_raise_out_of_memory();
+    }
+    pacer->frequency = glfwGetTimerFrequency();
+    pacer->last_frame = glfwGetTimerValue();
+    if (error_code != GLFW_NO_ERROR)
+    {
+        free(pacer->history);
+        free(pacer->sorted);
+        free(pacer);
+        raise_if_error();
+    }
+    pacer->late_frames = 0;
+    pacer->capacity = capacity;
+    pacer->head = 0;
+    pacer->count = 0;
+    frame_pacer_set_target(pacer, fps);
+    return Val_cptr(pacer);
+}
+
+CAMLprim value caml_glfwFramePacerCreate_byte(value fps, value history)
+{
+    return caml_glfwFramePacerCreate(Double_val(fps), history);
+}
+
+CAMLprim value caml_glfwFramePacerDestroy(value ml_pacer)
+{
+    struct frame_pacer* pacer = Pacer_val(ml_pacer);
+
+    free(pacer->history);
+    free(pacer->sorted);
+    free(pacer);
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwFramePacerSetTargetFps(value ml_pacer, double fps)
+{
+    frame_pacer_set_target(Pacer_val(ml_pacer), fps);
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwFramePacerSetTargetFps_byte(value ml_pacer, value fps)
+{
+    return caml_glfwFramePacerSetTargetFps(ml_pacer, Double_val(fps));
+}
+
+/* Swaps the buffers of the window, then processes events until the next
+   deadline. When the next deadline is already more than one period in the
+   past, the next frame is scheduled one period from now instead of trying
+   to catch up. A frame is late when it
+   takes more than one and a half period. */
+CAMLprim value caml_glfwFramePacerFrame(value ml_pacer, value window)
+{
+    struct frame_pacer* pacer = Pacer_val(ml_pacer);
+    uint64_t now, elapsed;
+
+    caml_glfwSwapBuffers(window);
+    if (pacer->period > 0)
+    {
+        now = glfwGetTimerValue();
+        while (now < pacer->deadline)
+        {
+            caml_glfwWaitEventsTimeout(
+                (double)(pacer->deadline - now) / pacer->frequency);
+            now = glfwGetTimerValue();
+        }
+    }
+    else
+        now = glfwGetTimerValue();
+    raise_if_error();
+    elapsed = now - pacer->last_frame;
+    if (pacer->period > 0)
+    {
+        if (2 * elapsed > 3 * pacer->period)
+            ++pacer->late_frames;
+        pacer->deadline += pacer->period;
+        if (pacer->deadline + pacer->period < now)
+            pacer->deadline = now + pacer->period;
+    }
+    pacer->last_frame = now;
+    pacer->history[(pacer->head + pacer->count) % pacer->capacity] =
+        (double)elapsed / pacer->frequency;
+    if (pacer->count < pacer->capacity)
+        ++pacer->count;
+    else
+        pacer->head = (pacer->head + 1) % pacer->capacity;
+    return Val_unit;
+}
+
+CAMLprim double caml_glfwFramePacerLastFrameTime(value ml_pacer)
+{
+    struct frame_pacer* pacer = Pacer_val(ml_pacer);
+
+    if (pacer->count == 0)
+        return 0.;
+    return pacer->history[(pacer->head + pacer->count - 1) % pacer->capacity];
+}
+
+CAMLprim value caml_glfwFramePacerLastFrameTime_byte(value ml_pacer)
+{
+    return caml_copy_double(caml_glfwFramePacerLastFrameTime(ml_pacer));
+}
+
+CAMLprim double caml_glfwFramePacerAverageFrameTime(value ml_pacer)
+{
+    struct frame_pacer* pacer = Pacer_val(ml_pacer);
+    double sum = 0.;
+
+    if (pacer->count == 0)
+        return 0.;
+    for (uintnat i = 0; i < pacer->count; ++i)
+        sum += pacer->history[i];
+    return sum / pacer->count;
+}
+
+CAMLprim value caml_glfwFramePacerAverageFrameTime_byte(value ml_pacer)
+{
+    return caml_copy_double(caml_glfwFramePacerAverageFrameTime(ml_pacer));
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of the recorded frame times, p being clamped to
+   [0, 1]. */
+CAMLprim double caml_glfwFramePacerPercentile(value ml_pacer, double p)
+{
+    struct frame_pacer* pacer = Pacer_val(ml_pacer);
+    uintnat rank;
+
+    if (pacer->count == 0)
+        return 0.;
+    memcpy(pacer->sorted, pacer->history,
+           pacer->count * sizeof(*pacer->sorted));
+    qsort(pacer->sorted, pacer->count, sizeof(*pacer->sorted),
+          compare_doubles);
+    /* Written so that NaN is mapped to 0 */
+    p = p >= 0. ? (p > 1. ? 1. : p) : 0.;
+    rank = (uintnat)(p * pacer->count);
+    if (rank < p * pacer->count)
+        ++rank;
+    return pacer->sorted[rank == 0 ? 0 : rank - 1];
+}
+
+CAMLprim value caml_glfwFramePacerPercentile_byte(value ml_pacer, value p)
+{
+    return caml_copy_double(
+        caml_glfwFramePacerPercentile(ml_pacer, Double_val(p)));
+}
+
+CAMLprim value caml_glfwFramePacerLateFrames(value ml_pacer)
+{
+    return Val_long(Pacer_val(ml_pacer)->late_frames);
+}
+
+CAMLprim value caml_glfwFramePacerFrameCount(value ml_pacer)
+{
+    return Val_long(Pacer_val(ml_pacer)->count);
+}
+
+CAMLprim value caml_glfwFramePacerReset(value ml_pacer)
+{
+    struct frame_pacer* pacer = Pacer_val(ml_pacer);
+
+    pacer->late_frames = 0;
+    pacer->head = 0;
+    pacer->count = 0;
+    return Val_unit;
+}
+
+/* Icon sets. The images of a set and their pixels are held in a single
+   allocation, ready to be handed to glfwSetWindowIcon. */
+struct icon_set
+{
+    int count;
+    GLFWimage images[];
+};
+
+#define Icon_set_val(v) Cptr_val(struct icon_set*, v)
+
+/* Box filter downscaling of RGBA pixels, with colors weighted by alpha so
+   that transparent pixels do not darken the edges. */
+static void downscale_image(const GLFWimage* src, GLFWimage* dst)
+{
+    for (int y = 0; y < dst->height; ++y)
+    {
+        int y0 = y * src->height / dst->height;
+        int y1 = (y + 1) * src->height / dst->height;
+
+        if (y1 == y0)
+            ++y1;
+        for (int x = 0; x < dst->width; ++x)
+        {
+            int x0 = x * src->width / dst->width;
+            int x1 = (x + 1) * src->width / dst->width;
+            uint64_t sum[4] = {0, 0, 0, 0};
+            unsigned char* out = dst->pixels + 4 * (y * dst->width + x);
+
+            if (x1 == x0)
+                ++x1;
+            for (int sy = y0; sy < y1; ++sy)
+                for (int sx = x0; sx < x1; ++sx)
+                {
+                    const unsigned char* in =
+                        src->pixels + 4 * (sy * src->width + sx);
+
+                    sum[0] += in[0] * in[3];
+                    sum[1] += in[1] * in[3];
+                    sum[2] += in[2] * in[3];
+                    sum[3] += in[3];
+                }
+            for (int c = 0; c < 3; ++c)
+                out[c] = sum[3] == 0 ? 0 : sum[c] / sum[3];
+            out[3] = sum[3] / ((x1 - x0) * (y1 - y0));
+        }
+    }
+}
+
+/* Builds a set holding one image per width in the sizes array, keeping the
+   aspect ratio of the source, or the source itself if sizes is empty. */
+CAMLprim value caml_glfwIconSetCreate(value image, value sizes)
+{
+    GLFWimage src;
+    int count = Wosize_val(sizes) == 0 ? 1 : Wosize_val(sizes);
+    size_t bytes = sizeof(struct icon_set) + count * sizeof(GLFWimage);
+    struct icon_set* set;
+    unsigned char* pixels;
+
+    src.width = Int_val(Field(image, 0));
+    src.height = Int_val(Field(image, 1));
+    src.pixels = Caml_ba_data_val(Field(image, 2));
+    for (int i = 0; i < count; ++i)
+    {
+        int width = Wosize_val(sizes) == 0 ? src.width
+                                           : Int_val(Field(sizes, i));
+        int height = (long)src.height * width / src.width;
+
+        bytes += 4 * (size_t)width * (height == 0 ? 1 : height);
+    }
+    set = malloc(bytes);
+    if (set == NULL)
+        caml_raise_out_of_memory();
+    set->count = count;
+    pixels = (unsigned char*)&set->images[count];
+    for (int i = 0; i < count; ++i)
+    {
+        GLFWimage* dst = &set->images[i];
+
+        dst->width = Wosize_val(sizes) == 0 ? src.width
+                                            : Int_val(Field(sizes, i));
+        dst->height = (long)src.height * dst->width / src.width;
+        if (dst->height == 0)
+            dst->height = 1;
+        dst->pixels = pixels;
+        if (dst->width == src.width)
+            memcpy(pixels, src.pixels, 4 * (size_t)src.width * src.height);
+        else
+            downscale_image(&src, dst);
+        pixels += 4 * (size_t)dst->width * dst->height;
+    }
+    return Val_cptr(set);
+}
+
+CAMLprim value caml_glfwIconSetDestroy(value set)
+{
+    free(Icon_set_val(set));
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwIconSetApply(value window, value ml_set)
+{
+    struct icon_set* set = Icon_set_val(ml_set);
+
+    glfwSetWindowIcon(Cptr_val(GLFWwindow*, window), set->count, set->images);
+    raise_if_error();
+    return Val_unit;
+}
+
+/* Animated cursors. All their frames are created upfront and the cursor of
+   the windows they are set on is switched to the current frame at the end
+   of pollEvents, waitEvents and waitEventsTimeout. */
+struct animated_cursor
+{
+    struct animated_cursor* next;
+    double start;
+    double frame_duration;
+    int current;
+    int changed;
+    int count;
+    GLFWcursor* frames[];
+};
+
+static struct animated_cursor* animated_cursors = NULL;
+
+#define Animated_cursor_val(v) Cptr_val(struct animated_cursor*, v)
+
+static void animated_cursors_tick(void)
+{
+    double now;
+
+    if (animated_window_count == 0)
+        return;
+    now = glfwGetTime();
+    for (struct animated_cursor* c = animated_cursors; c != NULL; c = c->next)
+    {
+        int frame;
+
+        /* The animation restarts when setTime moves the timer backwards. */
+        if (now < c->start)
+            c->start = now;
+        frame =
+            (uintnat)((now - c->start) / c->frame_duration) % c->count;
+
+        c->changed = frame != c->current;
+        c->current = frame;
+    }
+    for (uintnat id = 0; id < window_table_used; ++id)
+    {
+        struct animated_cursor* c = window_states[id].animated_cursor;
+
+        if (c != NULL && c->changed)
+            glfwSetCursor(window_states[id].window, c->frames[c->current]);
+    }
+}
+
+CAMLprim value caml_glfwAnimatedCursorCreate(
+    value frames, value xhot, value yhot, double frame_duration)
+{
+    int count = Wosize_val(frames);
+    struct animated_cursor* cursor =
+        malloc(sizeof(*cursor) + count * sizeof(GLFWcursor*));
+
+    if (cursor == NULL)
+        caml_raise_out_of_memory();
+    for (int i = 0; i < count; ++i)
+    {
+        value image = Field(frames, i);
+        GLFWimage glfw_image;
+
+        glfw_image.width = Int_val(Field(image, 0));
+        glfw_image.height = Int_val(Field(image, 1));
+        glfw_image.pixels = Caml_ba_data_val(Field(image, 2));
+        cursor->frames[i] =
+            glfwCreateCursor(&glfw_image, Int_val(xhot), Int_val(yhot));
+        if (cursor->frames[i] == NULL)
+        {
+            while (i > 0)
+                glfwDestroyCursor(cursor->frames[--i]);
+            free(cursor);
+            raise_if_error();
+            caml_raise_out_of_memory();
+        }
+    }
+    cursor->start = glfwGetTime();
+    cursor->frame_duration = frame_duration;
+    cursor->current = 0;
+    cursor->changed = 0;
+    cursor->count = count;
+    cursor->next = animated_cursors;
+    animated_cursors = cursor;
+    return Val_cptr(cursor);
+}
+
+CAMLprim value caml_glfwAnimatedCursorCreate_byte(
+    value frames, value xhot, value yhot, value frame_duration)
+{
+    return caml_glfwAnimatedCursorCreate(
+        frames, xhot, yhot, Double_val(frame_duration));
+}
+
+CAMLprim value caml_glfwAnimatedCursorDestroy(value ml_cursor)
+{
+    struct animated_cursor* cursor = Animated_cursor_val(ml_cursor);
+    struct animated_cursor** link = &animated_cursors;
+
+    for (uintnat id = 0; id < window_table_used; ++id)
+        if (window_states[id].animated_cursor == cursor)
+        {
+            window_states[id].animated_cursor = NULL;
+            --animated_window_count;
+        }
+    while (*link != cursor)
+        link = &(*link)->next;
+    *link = cursor->next;
+    for (int i = 0; i < cursor->count; ++i)
+        glfwDestroyCursor(cursor->frames[i]);
+    free(cursor);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwAnimatedCursorSet(value ml_window, value ml_cursor)
+{
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    struct animated_cursor* cursor = Animated_cursor_val(ml_cursor);
+    uintnat id = window_id(window);
+
+    raise_if_error();
+    glfwSetCursor(window, cursor->frames[cursor->current]);
+    raise_if_error();
+    if (window_states[id].animated_cursor == NULL)
+        ++animated_window_count;
+    window_states[id].animated_cursor = cursor;
+    return Val_unit;
+}
+
+/* Fences. The sync functions are resolved with glfwGetProcAddress, the
+   library not linking against OpenGL itself. Function pointers may depend on
+   the context, as with WGL, so they are kept per thread for the context
+   current when they were resolved, and resolved again when another context
+   is made current or once a window was destroyed, as its context may have
+   been replaced by one at the same address. Sync objects are shared between
+   the contexts of a share group, so a fence inserted by a context can be
+   waited on by any other context sharing it. Contexts lacking sync objects
+   (OpenGL < 3.2 and OpenGL ES < 3.0 without ARB_sync) wait for their
+   commands to complete instead and return a NULL fence, which is always
+   signaled. */
+#ifdef _WIN32
+# define ML_GL_APIENTRY __stdcall
+#else
+# define ML_GL_APIENTRY
+#endif
+
+#define ML_GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define ML_GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define ML_GL_TIMEOUT_IGNORED 0xFFFFFFFFFFFFFFFFull
+#define ML_GL_ALREADY_SIGNALED 0x911A
+#define ML_GL_CONDITION_SATISFIED 0x911C
+#define ML_GL_VERSION 0x1F02
+
+struct gl_context_key
+{
+    GLFWwindow* context;
+    uint64_t generation;
+};
+
+/* Returns whether the current context differs from the one key was set for,
+   and sets key to it. */
+static int gl_context_changed(struct gl_context_key* key)
+{
+    GLFWwindow* context = glfwGetCurrentContext();
+    uint64_t generation = ml_atomic_load(&context_generation);
+
+    if (key->context == context && key->generation == generation)
+        return 0;
+    key->context = context;
+    key->generation = generation;
+    return 1;
+}
+
+/* Returns the version of the current context as 10 * major + minor, or 0 if
+   it is unknown, and whether it is an OpenGL ES context. glGetString is
+   used rather than the window attributes, which may only be read from the
+   main thread. */
+static int gl_context_version(int* es)
+{
+    const char* (ML_GL_APIENTRY* get_string)(unsigned int) =
+        (const char* (ML_GL_APIENTRY*)(unsigned int))
+        glfwGetProcAddress("glGetString");
+    const char* version = get_string != NULL ? get_string(ML_GL_VERSION)
+                                             : NULL;
+    int major, minor;
+
+    *es = 0;
+    if (version == NULL)
+        return 0;
+    if (strncmp(version, "OpenGL ES", 9) == 0)
+    {
+        *es = 1;
+        while (*version != '\0' && (*version < '0' || *version > '9'))
+            ++version;
+    }
+    if (sscanf(version, "%d.%d", &major, &minor) != 2)
+        return 0;
+    return 10 * major + minor;
+}
+
+static ML_THREAD_LOCAL struct
+{
+    struct gl_context_key key;
+    int available;
+    void* (ML_GL_APIENTRY* fence_sync)(unsigned int, unsigned int);
+    unsigned int (ML_GL_APIENTRY* client_wait_sync)(
+        void*, unsigned int, uint64_t);
+    void (ML_GL_APIENTRY* wait_sync)(void*, unsigned int, uint64_t);
+    void (ML_GL_APIENTRY* delete_sync)(void*);
+    void (ML_GL_APIENTRY* flush)(void);
+    void (ML_GL_APIENTRY* finish)(void);
+} gl_sync;
+
+/* Raises NoCurrentContext with message if the calling thread has no current
+   context. */
+static void require_current_context(const char* message)
+{
+    if (glfwGetCurrentContext() == NULL)
+    {
+        raise_if_error();
+        caml_raise_with_string(
+            *error_exceptions[ml_error(GLFW_NO_CURRENT_CONTEXT) - 1], message);
+    }
+}
+
+/* Raises NoCurrentContext if the calling thread has no current context, and
+   returns whether sync objects are available. */
+static int gl_sync_resolve(void)
+{
+    require_current_context("Fence: no current context.");
+    if (gl_context_changed(&gl_sync.key))
+    {
+        int es, version = gl_context_version(&es);
+
+        gl_sync.fence_sync = (void* (ML_GL_APIENTRY*)(unsigned int,
+            unsigned int))glfwGetProcAddress("glFenceSync");
+        gl_sync.client_wait_sync = (unsigned int (ML_GL_APIENTRY*)(void*,
+            unsigned int, uint64_t))glfwGetProcAddress("glClientWaitSync");
+        gl_sync.wait_sync = (void (ML_GL_APIENTRY*)(void*, unsigned int,
+            uint64_t))glfwGetProcAddress("glWaitSync");
+        gl_sync.delete_sync = (void (ML_GL_APIENTRY*)(void*))
+            glfwGetProcAddress("glDeleteSync");
+        gl_sync.flush = (void (ML_GL_APIENTRY*)(void))
+            glfwGetProcAddress("glFlush");
+        gl_sync.finish = (void (ML_GL_APIENTRY*)(void))
+            glfwGetProcAddress("glFinish");
+        gl_sync.available = (es ? version >= 30 : version >= 32)
+            || glfwExtensionSupported("GL_ARB_sync");
+        gl_sync.available &= gl_sync.fence_sync != NULL
+            && gl_sync.client_wait_sync != NULL && gl_sync.wait_sync != NULL
+            && gl_sync.delete_sync != NULL;
+        if (error_code != GLFW_NO_ERROR)
+            gl_sync.key.context = NULL;
+        raise_if_error();
+    }
+    return gl_sync.available;
+}
+
+CAMLprim value caml_glfwFenceInsert(CAMLvoid)
+{
+    void* sync = NULL;
+
+    if (gl_sync_resolve())
+        sync = gl_sync.fence_sync(ML_GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    /* The fence must reach the GPU before other contexts wait on it. */
+    if (sync != NULL)
+        gl_sync.flush();
+    else
+        gl_sync.finish();
+    return Val_cptr(sync);
+}
+
+CAMLprim value caml_glfwFenceWait(value fence)
+{
+    void* sync = Cptr_val(void*, fence);
+
+    if (gl_sync_resolve() && sync != NULL)
+        gl_sync.wait_sync(sync, 0, ML_GL_TIMEOUT_IGNORED);
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwFenceClientWait(value fence, double timeout)
+{
+    void* sync = Cptr_val(void*, fence);
+    uint64_t nanoseconds;
+    unsigned int status;
+
+    if (!gl_sync_resolve() || sync == NULL)
+        return Val_true;
+    /* Written so that NaN is mapped to 0, large and infinite timeouts
+       being saturated. */
+    if (!(timeout > 0.))
+        nanoseconds = 0;
+    else if (timeout * 1e9 >= (double)(ML_GL_TIMEOUT_IGNORED - 1))
+        nanoseconds = ML_GL_TIMEOUT_IGNORED - 1;
+    else
+        nanoseconds = (uint64_t)(timeout * 1e9);
+    if (nanoseconds == 0)
+        status = gl_sync.client_wait_sync(sync, 0, 0);
+    else
+    {
+        caml_enter_blocking_section();
+        status = gl_sync.client_wait_sync(
+            sync, ML_GL_SYNC_FLUSH_COMMANDS_BIT, nanoseconds);
+        caml_leave_blocking_section();
+    }
+    return Val_bool(status == ML_GL_ALREADY_SIGNALED
+                    || status == ML_GL_CONDITION_SATISFIED);
+}
+
+CAMLprim value caml_glfwFenceClientWait_byte(value fence, value timeout)
+{
+    return caml_glfwFenceClientWait(fence, Double_val(timeout));
+}
+
+CAMLprim value caml_glfwFenceDelete(value fence)
+{
+    void* sync = Cptr_val(void*, fence);
+
+    if (gl_sync_resolve() && sync != NULL)
+        gl_sync.delete_sync(sync);
+    return Val_unit;
+}
+
+/* Offscreen readback. Frames are read from the current read framebuffer
+   into a ring of pixel pack buffers, a fence marking when each read is
+   complete, and are copied to the caller's buffer once it is signaled so
+   that glReadPixels does not stall the rendering thread. Contexts without
+   pixel buffer objects read synchronously. The pixel pack state of the
+   application is saved and restored around every read, frames being read
+   tightly packed. The function table is kept like that of the fences. */
+#define ML_GL_RGBA 0x1908
+#define ML_GL_UNSIGNED_BYTE 0x1401
+#define ML_GL_PIXEL_PACK_BUFFER 0x88EB
+#define ML_GL_PIXEL_PACK_BUFFER_BINDING 0x88ED
+#define ML_GL_STREAM_READ 0x88E1
+#define ML_GL_READ_ONLY 0x88B8
+#define ML_GL_MAP_READ_BIT 0x0001
+#define ML_GL_PACK_ROW_LENGTH 0x0D02
+#define ML_GL_PACK_SKIP_ROWS 0x0D03
+#define ML_GL_PACK_SKIP_PIXELS 0x0D04
+#define ML_GL_PACK_ALIGNMENT 0x0D05
+#define OFFSCREEN_MAX_BUFFERS 8
+
+static ML_THREAD_LOCAL struct
+{
+    struct gl_context_key key;
+    int pbo;
+    int pack_row_length;
+    void (ML_GL_APIENTRY* read_pixels)(int, int, int, int, unsigned int,
+                                       unsigned int, void*);
+    void (ML_GL_APIENTRY* get_integerv)(unsigned int, int*);
+    void (ML_GL_APIENTRY* pixel_storei)(unsigned int, int);
+    void (ML_GL_APIENTRY* gen_buffers)(int, unsigned int*);
+    void (ML_GL_APIENTRY* delete_buffers)(int, const unsigned int*);
+    void (ML_GL_APIENTRY* bind_buffer)(unsigned int, unsigned int);
+    void (ML_GL_APIENTRY* buffer_data)(unsigned int, ptrdiff_t, const void*,
+                                       unsigned int);
+    void* (ML_GL_APIENTRY* map_buffer_range)(unsigned int, ptrdiff_t,
+                                             ptrdiff_t, unsigned int);
+    void* (ML_GL_APIENTRY* map_buffer)(unsigned int, unsigned int);
+    unsigned char (ML_GL_APIENTRY* unmap_buffer)(unsigned int);
+} gl_readback;
+
+struct offscreen
+{
+    int width;
+    int height;
+    int count;
+    int head;
+    int pending;
+    unsigned int buffers[OFFSCREEN_MAX_BUFFERS];
+    void* syncs[OFFSCREEN_MAX_BUFFERS];
+};
+
+#define Offscreen_val(v) Cptr_val(struct offscreen*, v)
+
+/* Raises NoCurrentContext if the calling thread has no current context, and
+   returns whether pixel buffer objects are available. */
+static int gl_readback_resolve(void)
+{
+    require_current_context("Offscreen: no current context.");
+    if (gl_context_changed(&gl_readback.key))
+    {
+        int es, version = gl_context_version(&es);
+
+        gl_readback.read_pixels = (void (ML_GL_APIENTRY*)(int, int, int, int,
+            unsigned int, unsigned int, void*))
+            glfwGetProcAddress("glReadPixels");
+        gl_readback.get_integerv = (void (ML_GL_APIENTRY*)(unsigned int,
+            int*))glfwGetProcAddress("glGetIntegerv");
+        gl_readback.pixel_storei = (void (ML_GL_APIENTRY*)(unsigned int,
+            int))glfwGetProcAddress("glPixelStorei");
+        gl_readback.gen_buffers = (void (ML_GL_APIENTRY*)(int,
+            unsigned int*))glfwGetProcAddress("glGenBuffers");
+        gl_readback.delete_buffers = (void (ML_GL_APIENTRY*)(int,
+            const unsigned int*))glfwGetProcAddress("glDeleteBuffers");
+        gl_readback.bind_buffer = (void (ML_GL_APIENTRY*)(unsigned int,
+            unsigned int))glfwGetProcAddress("glBindBuffer");
+        gl_readback.buffer_data = (void (ML_GL_APIENTRY*)(unsigned int,
+            ptrdiff_t, const void*, unsigned int))
+            glfwGetProcAddress("glBufferData");
+        gl_readback.map_buffer_range = (void* (ML_GL_APIENTRY*)(unsigned int,
+            ptrdiff_t, ptrdiff_t, unsigned int))
+            glfwGetProcAddress("glMapBufferRange");
+        gl_readback.map_buffer = (void* (ML_GL_APIENTRY*)(unsigned int,
+            unsigned int))glfwGetProcAddress("glMapBuffer");
+        gl_readback.unmap_buffer = (unsigned char (ML_GL_APIENTRY*)(
+            unsigned int))glfwGetProcAddress("glUnmapBuffer");
+        /* OpenGL ES 2.0 has no pack row length nor skip parameters. */
+        gl_readback.pack_row_length = !es || version >= 30;
+        /* Pixel buffer objects are core in OpenGL 2.1 and OpenGL ES 3.0,
+           which also has glMapBufferRange, core in OpenGL 3.0. */
+        gl_readback.pbo = es ? version >= 30
+            : version >= 21
+              || glfwExtensionSupported("GL_ARB_pixel_buffer_object");
+        if (!(es ? version >= 30
+              : version >= 30
+                || glfwExtensionSupported("GL_ARB_map_buffer_range")))
+            gl_readback.map_buffer_range = NULL;
+        if (es)
+            gl_readback.map_buffer = NULL;
+        gl_readback.pbo &= gl_readback.gen_buffers != NULL
+            && gl_readback.delete_buffers != NULL
+            && gl_readback.bind_buffer != NULL
+            && gl_readback.buffer_data != NULL
+            && gl_readback.unmap_buffer != NULL
+            && (gl_readback.map_buffer_range != NULL
+                || gl_readback.map_buffer != NULL);
+        if (error_code != GLFW_NO_ERROR)
+            gl_readback.key.context = NULL;
+        raise_if_error();
+    }
+    if (gl_readback.read_pixels == NULL || gl_readback.get_integerv == NULL
+        || gl_readback.pixel_storei == NULL)
+        caml_failwith("Offscreen: glReadPixels is unavailable.");
+    return gl_readback.pbo;
+}
+
+struct pack_state
+{
+    int buffer;
+    int row_length;
+    int skip_rows;
+    int skip_pixels;
+    int alignment;
+};
+
+/* Saves the pixel pack state of the application into saved and sets it for
+   reading tightly packed RGBA rows into buffer, or client memory if 0. */
+static void pack_state_set(struct pack_state* saved, unsigned int buffer)
+{
+    gl_readback.get_integerv(ML_GL_PACK_ALIGNMENT, &saved->alignment);
+    gl_readback.pixel_storei(ML_GL_PACK_ALIGNMENT, 4);
+    if (gl_readback.pack_row_length)
+    {
+        gl_readback.get_integerv(ML_GL_PACK_ROW_LENGTH, &saved->row_length);
+        gl_readback.get_integerv(ML_GL_PACK_SKIP_ROWS, &saved->skip_rows);
+        gl_readback.get_integerv(ML_GL_PACK_SKIP_PIXELS, &saved->skip_pixels);
+        gl_readback.pixel_storei(ML_GL_PACK_ROW_LENGTH, 0);
+        gl_readback.pixel_storei(ML_GL_PACK_SKIP_ROWS, 0);
+        gl_readback.pixel_storei(ML_GL_PACK_SKIP_PIXELS, 0);
+    }
+    if (gl_readback.pbo)
+    {
+        gl_readback.get_integerv(ML_GL_PIXEL_PACK_BUFFER_BINDING,
+                                 &saved->buffer);
+        gl_readback.bind_buffer(ML_GL_PIXEL_PACK_BUFFER, buffer);
+    }
+}
+
+static void pack_state_restore(const struct pack_state* saved)
+{
+    gl_readback.pixel_storei(ML_GL_PACK_ALIGNMENT, saved->alignment);
+    if (gl_readback.pack_row_length)
+    {
+        gl_readback.pixel_storei(ML_GL_PACK_ROW_LENGTH, saved->row_length);
+        gl_readback.pixel_storei(ML_GL_PACK_SKIP_ROWS, saved->skip_rows);
+        gl_readback.pixel_storei(ML_GL_PACK_SKIP_PIXELS, saved->skip_pixels);
+    }
+    if (gl_readback.pbo)
+        gl_readback.bind_buffer(ML_GL_PIXEL_PACK_BUFFER, saved->buffer);
+}
+
+CAMLprim value caml_glfwOffscreenCreate(value width, value height,
+                                        value count)
+{
+    struct offscreen* offscreen;
+    int bound, pbo = gl_readback_resolve();
+
+    if (Int_val(width) <= 0 || Int_val(height) <= 0)
+        caml_invalid_argument("Offscreen.create: invalid size.");
+    if (Int_val(count) < 1 || Int_val(count) > OFFSCREEN_MAX_BUFFERS)
+        caml_invalid_argument("Offscreen.create: invalid buffer count.");
+    offscreen = calloc(1, sizeof(*offscreen));
+    if (offscreen == NULL)
+        caml_raise_out_of_memory();
+    offscreen->width = Int_val(width);
+    offscreen->height = Int_val(height);
+    if (pbo)
+    {
+        offscreen->count = Int_val(count);
+        gl_readback.get_integerv(ML_GL_PIXEL_PACK_BUFFER_BINDING, &bound);
+        gl_readback.gen_buffers(offscreen->count, offscreen->buffers);
+        for (int i = 0; i < offscreen->count; ++i)
+        {
+            gl_readback.bind_buffer(ML_GL_PIXEL_PACK_BUFFER,
+                                    offscreen->buffers[i]);
+            gl_readback.buffer_data(
+                ML_GL_PIXEL_PACK_BUFFER,
+                (ptrdiff_t)offscreen->width * offscreen->height * 4, NULL,
+                ML_GL_STREAM_READ);
+        }
+        gl_readback.bind_buffer(ML_GL_PIXEL_PACK_BUFFER, bound);
+    }
+    return Val_cptr(offscreen);
+}
+
+CAMLprim value caml_glfwOffscreenDestroy(value ml_offscreen)
+{
+    struct offscreen* offscreen = Offscreen_val(ml_offscreen);
+
+    if (offscreen->count > 0 && gl_readback_resolve())
+    {
+        gl_sync_resolve();
+        for (int i = 0; i < offscreen->pending; ++i)
+        {
+            void* sync = offscreen->syncs[(offscreen->head + i)
+                                          % offscreen->count];
+            if (sync != NULL)
+                gl_sync.delete_sync(sync);
+        }
+        gl_readback.delete_buffers(offscreen->count, offscreen->buffers);
+    }
+    free(offscreen);
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwOffscreenPending(value offscreen)
+{
+    return Val_int(Offscreen_val(offscreen)->pending);
+}
+
+CAMLprim value caml_glfwOffscreenCapacity(value offscreen)
+{
+    return Val_int(Offscreen_val(offscreen)->count);
+}
+
+/* Starts reading the current read framebuffer into the next buffer of the
+   ring, which must not be full. Without pixel buffer objects, reads it into
+   frame directly and returns true. */
+CAMLprim value caml_glfwOffscreenRead(value ml_offscreen, value frame)
+{
+    struct offscreen* offscreen = Offscreen_val(ml_offscreen);
+    struct pack_state saved;
+    int index;
+
+    gl_readback_resolve();
+    if (offscreen->count == 0)
+    {
+        pack_state_set(&saved, 0);
+        gl_readback.read_pixels(0, 0, offscreen->width, offscreen->height,
+                                ML_GL_RGBA, ML_GL_UNSIGNED_BYTE,
+                                Caml_ba_data_val(frame));
+        pack_state_restore(&saved);
+        return Val_true;
+    }
+    assert(offscreen->pending < offscreen->count);
+    index = (offscreen->head + offscreen->pending) % offscreen->count;
+    pack_state_set(&saved, offscreen->buffers[index]);
+    gl_readback.read_pixels(0, 0, offscreen->width, offscreen->height,
+                            ML_GL_RGBA, ML_GL_UNSIGNED_BYTE, NULL);
+    pack_state_restore(&saved);
+    offscreen->syncs[index] = Cptr_val(void*, caml_glfwFenceInsert(Val_unit));
+    ++offscreen->pending;
+    return Val_false;
+}
+
+/* Copies the oldest pending frame to frame if its read is complete, waiting
+   for it if wait is true, and returns whether it did. */
+CAMLprim value caml_glfwOffscreenCollect(value ml_offscreen, value frame,
+                                         value wait)
+{
+    CAMLparam1(frame);
+    struct offscreen* offscreen = Offscreen_val(ml_offscreen);
+    size_t size = (size_t)offscreen->width * offscreen->height * 4;
+    int bound, index = offscreen->head;
+    void* sync;
+    void* pixels;
+
+    if (offscreen->pending == 0)
+        CAMLreturn(Val_false);
+    gl_readback_resolve();
+    sync = offscreen->syncs[index];
+    if (sync != NULL)
+    {
+        if (!Bool_val(wait))
+        {
+            if (!Bool_val(caml_glfwFenceClientWait(Val_cptr(sync), 0.)))
+                CAMLreturn(Val_false);
+        }
+        else
+            while (!Bool_val(caml_glfwFenceClientWait(Val_cptr(sync), 1.)))
+                ;
+        gl_sync.delete_sync(sync);
+        offscreen->syncs[index] = NULL;
+    }
+    gl_readback.get_integerv(ML_GL_PIXEL_PACK_BUFFER_BINDING, &bound);
+    gl_readback.bind_buffer(ML_GL_PIXEL_PACK_BUFFER,
+                            offscreen->buffers[index]);
+    pixels = gl_readback.map_buffer_range != NULL
+        ? gl_readback.map_buffer_range(ML_GL_PIXEL_PACK_BUFFER, 0, size,
+                                       ML_GL_MAP_READ_BIT)
+        : gl_readback.map_buffer(ML_GL_PIXEL_PACK_BUFFER, ML_GL_READ_ONLY);
+    if (pixels != NULL)
+    {
+        memcpy(Caml_ba_data_val(frame), pixels, size);
+        gl_readback.unmap_buffer(ML_GL_PIXEL_PACK_BUFFER);
+    }
+    gl_readback.bind_buffer(ML_GL_PIXEL_PACK_BUFFER, bound);
+    offscreen->head = (offscreen->head + 1) % offscreen->count;
+    --offscreen->pending;
+    if (pixels == NULL)
+        caml_failwith("Offscreen.collect: could not map the pixel buffer.");
+    CAMLreturn(Val_true);
+}
+
+/* Replay of a recording. Each event is dispatched to the stub GLFW would
+   call for the window in its current state, so that it reaches the same
+   closures or the event queue. Windows are identified by their serial,
+   which matches as long as windows are created in the same order as when
+   recording. Events of windows that no longer exist are skipped. */
+struct replayer
+{
+    unsigned char* data;
+    size_t size;
+    size_t position;
+    double tick_duration;
+    uint64_t time;
+    double start;
+    char* drop;
+};
+
+#define Replayer_val(v) Cptr_val(struct replayer*, v)
+
+static int get_varint(struct replayer* replayer, uint64_t* v)
+{
+    *v = 0;
+    for (int shift = 0;
+         replayer->position < replayer->size && shift < 64; shift += 7)
+    {
+        unsigned char byte = replayer->data[replayer->position++];
+        *v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return 1;
+    }
+    return 0;
+}
+
+static int get_int(struct replayer* replayer, int* v)
+{
+    uint64_t u;
+
+    if (!get_varint(replayer, &u))
+        return 0;
+    *v = (int)((int64_t)(u >> 1) ^ -(int64_t)(u & 1));
+    return 1;
+}
+
+static int get_double(struct replayer* replayer, double* d)
+{
+    uint64_t bits = 0;
+
+    if (replayer->size - replayer->position < 8)
+        return 0;
+    for (int i = 0; i < 8; ++i)
+        bits |= (uint64_t)replayer->data[replayer->position++] << (8 * i);
+    memcpy(d, &bits, sizeof(*d));
+    return 1;
+}
+
+static void replay_invalid(struct replayer* replayer)
+{
+    replayer->position = replayer->size;
+    caml_failwith("Replayer: invalid recording.");
+}
+
+/* Reads the paths of a drop into a single allocation. */
+static const char** replay_read_drop(struct replayer* replayer, int count)
+{
+    size_t start = replayer->position, size = 0;
+    uint64_t length;
+    const char** paths;
+    char* data;
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (!get_varint(replayer, &length)
+            || length > replayer->size - replayer->position)
+            replay_invalid(replayer);
+        replayer->position += length;
+        size += length + 1;
+    }
+    free(replayer->drop);
+    replayer->drop = malloc(count * sizeof(*paths) + size);
+    if (replayer->drop == NULL)
+        caml_raise_out_of_memory();
+    paths = (const char**)replayer->drop;
+    data = replayer->drop + count * sizeof(*paths);
+    replayer->position = start;
+    for (int i = 0; i < count; ++i)
+    {
+        get_varint(replayer, &length);
+        memcpy(data, replayer->data + replayer->position, length);
+        data[length] = '\0';
+        paths[i] = data;
+        data += length + 1;
+        replayer->position += length;
+    }
+    return paths;
+}
+
+static void replay_device(struct replayer* replayer, int kind, uint64_t id)
+{
+    int event, count;
+    GLFWmonitor** monitors;
+
+    if (!get_int(replayer, &event)
+        || (event != GLFW_CONNECTED && event != GLFW_DISCONNECTED))
+        replay_invalid(replayer);
+    if (kind == RecordJoystick)
+    {
+        if (id > GLFW_JOYSTICK_LAST)
+            replay_invalid(replayer);
+        if (joystick_closure != Val_unit)
+            joystick_callback_stub((int)id, event);
+    }
+    else if (id > 0)
+    {
+        monitors = glfwGetMonitors(&count);
+        if (id <= (uint64_t)count)
+            monitor_callback_stub(monitors[id - 1], event);
+    }
+}
+
+#define REPLAY(name, set, args)                                         \
+    if (Bool_val(callbacks->queued))                                    \
+        name##_queue_stub args;                                         \
+    else if (set)                                                       \
+        name##_callback_stub args;                                      \
+    break
+
+/* Dispatches the next event. Returns false at the end of the recording. */
+static int replay_next(struct replayer* replayer)
+{
+    int kind, count = 0, ints[4] = {0};
+    double floats[2] = {0.};
+    uint64_t delta, id;
+    const char** paths = NULL;
+    GLFWwindow* window;
+    struct ml_window_callbacks* callbacks;
+
+    if (replayer->position == replayer->size)
+        return 0;
+    kind = replayer->data[replayer->position++];
+    if (kind > RecordMonitor || !get_varint(replayer, &delta)
+        || !get_varint(replayer, &id))
+        replay_invalid(replayer);
+    replayer->time += delta;
+    if (kind == RecordJoystick || kind == RecordMonitor)
+    {
+        replay_device(replayer, kind, id);
+        return 1;
+    }
+    if (kind == RecordDrop)
+    {
+        if (!get_int(replayer, &count) || count < 0)
+            replay_invalid(replayer);
+        paths = replay_read_drop(replayer, count);
+    }
+    else
+    {
+        for (int i = 0; i < record_int_count[kind]; ++i)
+            if (!get_int(replayer, ints + i))
+                replay_invalid(replayer);
+        for (int i = 0; i < record_float_count[kind]; ++i)
+            if (!get_double(replayer, floats + i))
+                replay_invalid(replayer);
+    }
+    if (kind == EventKey
+        && (ints[0] < GLFW_KEY_FIRST
+            || ints[0] - GLFW_KEY_FIRST >= (int)(sizeof(glfw_to_ml_key)
+                                                 / sizeof(*glfw_to_ml_key))
+            || glfw_to_ml_key[ints[0] - GLFW_KEY_FIRST] < 0
+            || ints[2] < GLFW_RELEASE || ints[2] > GLFW_REPEAT))
+        replay_invalid(replayer);
+    if (kind == EventMouseButton
+        && (ints[0] < 0 || ints[0] > GLFW_MOUSE_BUTTON_LAST
+            || ints[1] < GLFW_RELEASE || ints[1] > GLFW_PRESS))
+        replay_invalid(replayer);
+    window = NULL;
+    for (uintnat i = 0; i < window_table_used; ++i)
+        if (window_states[i].window != NULL && window_states[i].serial == id)
+            window = window_states[i].window;
+    if (window == NULL)
+        return 1;
+    callbacks = window_callbacks(window);
+    switch (kind)
+    {
+    case EventWindowPos:
+        REPLAY(window_pos, callbacks->window_pos != Val_unit,
+               (window, ints[0], ints[1]));
+    case EventWindowSize:
+        REPLAY(window_size, callbacks->window_size != Val_unit,
+               (window, ints[0], ints[1]));
+    case EventWindowClose:
+        /* GLFW sets the flag before calling the callback. */
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+        REPLAY(window_close, callbacks->window_close != Val_unit, (window));
+    case EventWindowRefresh:
+        REPLAY(window_refresh, callbacks->window_refresh != Val_unit,
+               (window));
+    case EventWindowFocus:
+        REPLAY(window_focus, callbacks->window_focus != Val_unit,
+               (window, ints[0]));
+    case EventWindowIconify:
+        REPLAY(window_iconify, callbacks->window_iconify != Val_unit,
+               (window, ints[0]));
+    case EventWindowMaximize:
+        REPLAY(window_maximize, callbacks->window_maximize != Val_unit,
+               (window, ints[0]));
+    case EventFramebufferSize:
+        REPLAY(framebuffer_size, callbacks->framebuffer_size != Val_unit,
+               (window, ints[0], ints[1]));
+    case EventWindowContentScale:
+        REPLAY(window_content_scale,
+               callbacks->window_content_scale != Val_unit,
+               (window, floats[0], floats[1]));
+    case EventKey:
+        REPLAY(key, callbacks->key != Val_unit
+               || callbacks->key_bits != Val_unit,
+               (window, ints[0], ints[1], ints[2], ints[3]));
+    case EventChar:
+        REPLAY(character, callbacks->character != Val_unit,
+               (window, ints[0]));
+    case EventCharMods:
+        REPLAY(character_mods, callbacks->character_mods != Val_unit
+               || callbacks->character_mods_bits != Val_unit,
+               (window, ints[0], ints[1]));
+    case EventMouseButton:
+        REPLAY(mouse_button, callbacks->mouse_button != Val_unit
+               || callbacks->mouse_button_bits != Val_unit,
+               (window, ints[0], ints[1], ints[2]));
+    case EventCursorPos:
+        REPLAY(cursor_pos, callbacks->cursor_pos != Val_unit,
+               (window, floats[0], floats[1]));
+    case EventCursorEnter:
+        REPLAY(cursor_enter, callbacks->cursor_enter != Val_unit,
+               (window, ints[0]));
+    case EventScroll:
+        REPLAY(scroll, callbacks->scroll != Val_unit,
+               (window, floats[0], floats[1]));
+    case RecordDrop:
+        if (callbacks->drop != Val_unit || callbacks->drop_paths != Val_unit)
+            drop_callback_stub(window, count, paths);
+        break;
+    }
+    return 1;
+}
+
+CAMLprim value caml_glfwReplayerCreate(value path)
+{
+    struct replayer* replayer;
+    FILE* file = fopen(String_val(path), "rb");
+    long size;
+    uint64_t frequency = 0;
+
+    if (file == NULL)
+        raise_sys_error(path);
+    replayer = calloc(1, sizeof(*replayer));
+    if (replayer == NULL
+        || fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0
+        || fseek(file, 0, SEEK_SET) != 0
+        || (replayer->data = malloc(size > 0 ? size : 1)) == NULL
+        || fread(replayer->data, 1, size, file) != (size_t)size)
+    {
+        fclose(file);
+        if (replayer != NULL)
+            free(replayer->data);
+        free(replayer);
+        raise_sys_error(path);
+    }
+    fclose(file);
+    replayer->size = size;
+    if (size >= 16)
+        for (int i = 0; i < 8; ++i)
+            frequency |= (uint64_t)replayer->data[8 + i] << (8 * i);
+    if (size < 16 || memcmp(replayer->data, RECORDING_MAGIC, 8) != 0
+        || frequency == 0)
+    {
+        free(replayer->data);
+        free(replayer);
+        caml_failwith("Replayer.create: invalid recording.");
+    }
+    replayer->position = 16;
+    replayer->tick_duration = 1. / (double)frequency;
+    replayer->start = -1.;
+    return Val_cptr(replayer);
+}
+
+CAMLprim value caml_glfwReplayerDestroy(value replayer)
+{
+    free(Replayer_val(replayer)->data);
+    free(Replayer_val(replayer)->drop);
+    free(Replayer_val(replayer));
+    return Val_unit;
+}
+
+/* Replayed events are not recorded again. Should a callback raise, the
+   recorder is resumed by Replayer.resume. */
+CAMLprim value caml_glfwReplayerStep(value replayer)
+{
+    int more;
+
+    recorder_suspended = 1;
+    more = replay_next(Replayer_val(replayer));
+    recorder_suspended = 0;
+    return Val_bool(more);
+}
+
+CAMLprim value caml_glfwReplayerAdvance(value ml_replayer)
+{
+    struct replayer* replayer = Replayer_val(ml_replayer);
+    double now = glfwGetTime();
+
+    raise_if_error();
+    if (replayer->start < 0.)
+        replayer->start = now;
+    recorder_suspended = 1;
+    while (replayer->position < replayer->size)
+    {
+        size_t position = replayer->position;
+        uint64_t delta;
+
+        ++replayer->position;
+        if (!get_varint(replayer, &delta))
+            replay_invalid(replayer);
+        replayer->position = position;
+        if ((double)(replayer->time + delta) * replayer->tick_duration
+            > now - replayer->start)
+            break;
+        replay_next(replayer);
+    }
+    recorder_suspended = 0;
+    return Val_bool(replayer->position < replayer->size);
+}
+
+CAMLprim value caml_glfwReplayerResume(CAMLvoid)
+{
+    recorder_suspended = 0;
+    return Val_unit;
 }
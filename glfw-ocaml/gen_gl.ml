@@ -0,0 +1,309 @@
+(* Generates the GLFW_GL module and its stubs from gl_functions.txt. *)
+
+type kind =
+  | Int of string
+  | Float of string
+  | Bool
+  | Ptr
+  | Offset
+  | String
+  | Void
+
+type func = { name : string; ret : kind; params : kind list }
+
+let kind_of_string = function
+  | "GLenum" | "GLbitfield" | "GLuint" -> Int "unsigned int"
+  | "GLint" | "GLsizei" -> Int "int"
+  | "GLbyte" -> Int "signed char"
+  | "GLubyte" -> Int "unsigned char"
+  | "GLshort" -> Int "short"
+  | "GLushort" -> Int "unsigned short"
+  | "GLintptr" | "GLsizeiptr" -> Int "ptrdiff_t"
+  | "GLint64" -> Int "int64_t"
+  | "GLuint64" -> Int "uint64_t"
+  | "GLfloat" | "GLclampf" -> Float "float"
+  | "GLdouble" | "GLclampd" -> Float "double"
+  | "GLboolean" -> Bool
+  | "ptr" -> Ptr
+  | "offset" -> Offset
+  | "string" -> String
+  | "void" -> Void
+  | t -> failwith ("gen_gl: unknown type " ^ t)
+
+let read_spec file =
+  let spec = open_in file in
+  let delim_regexp = Str.regexp "[ \t]+" in
+  let rec loop consts funcs =
+    match Str.split delim_regexp (input_line spec) with
+    | exception End_of_file ->
+       close_in_noerr spec;
+       List.rev consts, List.rev funcs
+    | [] -> loop consts funcs
+    | hd :: _ when hd.[0] = '#' -> loop consts funcs
+    | ["const"; name; value] -> loop ((name, value) :: consts) funcs
+    | name :: ret :: params ->
+       let ret = kind_of_string ret in
+       let params = List.map kind_of_string params in
+       begin match ret with
+       | Ptr | Offset | String ->
+          failwith ("gen_gl: invalid return type for " ^ name)
+       | _ when List.mem Void params ->
+          failwith ("gen_gl: void parameter for " ^ name)
+       | _ -> ()
+       end;
+       loop consts ({ name; ret; params } :: funcs)
+    | _ -> failwith "gen_gl: invalid line"
+  in
+  loop [] []
+
+(* glClearColor -> clearColor, GL_COLOR_BUFFER_BIT -> color_buffer_bit *)
+let ml_name name =
+  String.uncapitalize_ascii (Str.string_after name 2)
+
+let const_name name =
+  String.lowercase_ascii (Str.string_after name 3)
+
+let ml_type = function
+  | Int _ | Offset -> "(int [@untagged])"
+  | Float _ -> "(float [@unboxed])"
+  | Bool -> "bool"
+  | Ptr -> "(_, _, Bigarray.c_layout) Bigarray.Array1.t"
+  | String -> "string"
+  | Void -> "unit"
+
+let c_type = function
+  | Int t | Float t -> t
+  | Bool -> "unsigned char"
+  | Ptr | Offset -> "void*"
+  | String -> "const char*"
+  | Void -> "void"
+
+let native_type = function
+  | Int _ | Offset -> "intnat"
+  | Float _ -> "double"
+  | Bool | Ptr | String | Void -> "value"
+
+(* Converts the native stub argument to the type expected by OpenGL. *)
+let c_arg kind arg =
+  match kind with
+  | Int t | Float t -> Printf.sprintf "(%s)%s" t arg
+  | Bool -> Printf.sprintf "Bool_val(%s)" arg
+  | Ptr -> Printf.sprintf "Caml_ba_data_val(%s)" arg
+  | Offset -> Printf.sprintf "(void*)%s" arg
+  | String -> Printf.sprintf "String_val(%s)" arg
+  | Void -> assert false
+
+(* Converts the bytecode stub argument to the type of the native stub. *)
+let byte_arg kind arg =
+  match kind with
+  | Int _ | Offset -> Printf.sprintf "Long_val(%s)" arg
+  | Float _ -> Printf.sprintf "Double_val(%s)" arg
+  | Bool | Ptr | String | Void -> arg
+
+let byte_ret = function
+  | Int _ -> "Val_long"
+  | Float _ -> "caml_copy_double"
+  | Bool | Ptr | Offset | String | Void -> ""
+
+let external_decl buffer { name; ret; params } =
+  let open Printf in
+  let params = if params = [] then ["unit"] else List.map ml_type params in
+  bprintf buffer
+    "external %s :\n  %s\n  -> %s\n  = \"caml_%s_byte\" \"caml_%s\" [@@noalloc]\n"
+    (ml_name name) (String.concat " -> " params) (ml_type ret) name name
+
+let generate_ml buffer consts funcs =
+  let open Buffer in
+  let open Printf in
+  add_string buffer
+    "(* Generated by gen_gl.ml from gl_functions.txt, do not edit. *)\n\n";
+  add_string buffer
+    "external resolve : unit -> string list = \"caml_glfwGLResolve\"\n\n";
+  add_string buffer
+    "let load () =\n\
+    \  match GLFW.getCurrentContext () with\n\
+    \  | None ->\n\
+    \     raise (GLFW.NoCurrentContext \"GLFW_GL.load: no current context.\")\n\
+    \  | Some _ -> resolve ()\n\n";
+  List.iter (fun (name, value) ->
+      bprintf buffer "let %s = %s\n" (const_name name) value
+    ) consts;
+  add_string buffer "\n";
+  List.iter (external_decl buffer) funcs
+
+let generate_mli buffer consts funcs =
+  let open Buffer in
+  let open Printf in
+  add_string buffer
+    "(* Generated by gen_gl.ml from gl_functions.txt, do not edit. *)\n\n\
+     (** OpenGL functions resolved through glfwGetProcAddress.\n\n\
+    \    The functions listed in gl_functions.txt are loaded into a table\n\
+    \    of function pointers by the load function and are called directly\n\
+    \    through it, without going through the dispatch of the system OpenGL\n\
+    \    library.\n\
+    \    They are named after the OpenGL function without its gl prefix and\n\
+    \    constants after the OpenGL constant without its GL_ prefix, in lower\n\
+    \    case.\n\n\
+    \    Integer arguments are passed as int, floating-point ones as float\n\
+    \    and pointers as a Bigarray whose data is passed to the function.\n\
+    \    Offsets into a bound buffer, as taken by glVertexAttribPointer or\n\
+    \    glDrawElements, are passed as int.\n\n\
+    \    The size of a Bigarray is not checked against what the function\n\
+    \    reads or writes: glReadPixels or glGetIntegerv overrun a Bigarray\n\
+    \    shorter than the pixels or the values of the parameter queried.\n\n\
+    \    None of these functions check for OpenGL errors, use getError. *)\n\n\
+     (** Resolves every function with glfwGetProcAddress for the current\n\
+    \    context and returns the names of those that could not be resolved.\n\
+    \    Calling such a function, or any function before load, prints its\n\
+    \    name and aborts the program, since they cannot raise. The table is\n\
+    \    shared by all contexts: on platforms where function pointers are\n\
+    \    context-dependent, such as Windows, call it again after making a\n\
+    \    context with a different pixel format current.\n\
+    \    @raise GLFW.NoCurrentContext if no context is current.\n\
+    \    @raise GLFW.PlatformError if GLFW reports an error while resolving. *)\n\
+     val load : unit -> string list\n\n";
+  List.iter (fun (name, _) ->
+      bprintf buffer "val %s : int\n" (const_name name)
+    ) consts;
+  add_string buffer "\n";
+  List.iter (external_decl buffer) funcs
+
+let generate_stub buffer index { name; ret; params } =
+  let open Buffer in
+  let open Printf in
+  let args = List.mapi (fun i _ -> sprintf "a%d" i) params in
+  let arity = List.length params in
+  let call =
+    sprintf "((%s (GL_APIENTRY*)(%s))gl_functions[%d])(%s)"
+      (c_type ret)
+      (if params = [] then "void"
+       else String.concat ", " (List.map c_type params))
+      index
+      (String.concat ", " (List.map2 c_arg params args))
+  in
+  (* Native stub *)
+  bprintf buffer "\nCAMLprim %s caml_%s(%s)\n{\n"
+    (if ret = Void then "value" else native_type ret) name
+    (if params = [] then "CAMLvoid"
+     else String.concat ", " (List.map2 (fun kind arg ->
+              sprintf "%s %s" (native_type kind) arg) params args));
+  begin match ret with
+  | Void -> bprintf buffer "    %s;\n    return Val_unit;\n" call
+  | Bool -> bprintf buffer "    return Val_bool(%s);\n" call
+  | _ -> bprintf buffer "    return %s;\n" call
+  end;
+  add_string buffer "}\n";
+  (* Bytecode stub, taking an argument vector beyond 5 arguments *)
+  let byte_args =
+    if arity > 5 then List.mapi (fun i _ -> sprintf "argv[%d]" i) params
+    else args
+  in
+  bprintf buffer "\nCAMLprim value caml_%s_byte(%s)\n{\n" name
+    (if params = [] then "CAMLvoid"
+     else if arity > 5 then "value* argv, int argn"
+     else String.concat ", " (List.map (sprintf "value %s") args));
+  bprintf buffer "    return %s(caml_%s(%s));\n" (byte_ret ret) name
+    (if params = [] then "unit"
+     else String.concat ", " (List.map2 byte_arg params byte_args));
+  add_string buffer "}\n"
+
+let generate_trap buffer index { name; ret; params } =
+  Printf.bprintf buffer
+    "\nstatic %s GL_APIENTRY gl_trap_%s(%s)\n{\n    gl_missing(%d);\n}\n"
+    (c_type ret) name
+    (if params = [] then "void"
+     else String.concat ", " (List.mapi (fun i kind ->
+              Printf.sprintf "%s a%d" (c_type kind) i) params))
+    index
+
+let generate_c buffer funcs =
+  let open Buffer in
+  let open Printf in
+  add_string buffer
+    "/* Generated by gen_gl.ml from gl_functions.txt, do not edit. */\n\n\
+     #define GLFW_INCLUDE_NONE\n\
+     #include <GLFW/glfw3.h>\n\
+     #include <stddef.h>\n\
+     #include <stdint.h>\n\
+     #include <stdio.h>\n\
+     #include <stdlib.h>\n\
+     #include <caml/mlvalues.h>\n\
+     #include <caml/alloc.h>\n\
+     #include <caml/memory.h>\n\
+     #include <caml/bigarray.h>\n\n\
+     #ifdef CAMLunused_start\n\
+     # define CAMLvoid CAMLunused_start value unit CAMLunused_end\n\
+     #else\n\
+     # define CAMLvoid CAMLunused value unit\n\
+     #endif\n\n\
+     #ifdef _WIN32\n\
+     # define GL_APIENTRY __stdcall\n\
+     #else\n\
+     # define GL_APIENTRY\n\
+     #endif\n\n";
+  bprintf buffer "#define GL_FUNCTION_COUNT %d\n\n" (List.length funcs);
+  add_string buffer
+    "static const char* const gl_names[GL_FUNCTION_COUNT] = {\n";
+  List.iter (fun { name; _ } -> bprintf buffer "    \"%s\",\n" name) funcs;
+  add_string buffer "};\n\n\
+     CAMLnoreturn_start\n\
+     static void gl_missing(int index)\n\
+     CAMLnoreturn_end;\n\n\
+     static void gl_missing(int index)\n\
+     {\n\
+    \    fprintf(stderr, \"GLFW_GL: %s called but not loaded.\\n\",\n\
+    \            gl_names[index]);\n\
+    \    abort();\n\
+     }\n\n\
+     /* Functions not loaded point to a trap of the same type. */\n";
+  List.iteri (generate_trap buffer) funcs;
+  add_string buffer
+    "\nstatic const GLFWglproc gl_traps[GL_FUNCTION_COUNT] = {\n";
+  List.iter (fun { name; _ } ->
+      bprintf buffer "    (GLFWglproc)gl_trap_%s,\n" name
+    ) funcs;
+  add_string buffer "};\n\n\
+     static GLFWglproc gl_functions[GL_FUNCTION_COUNT] = {\n";
+  List.iter (fun { name; _ } ->
+      bprintf buffer "    (GLFWglproc)gl_trap_%s,\n" name
+    ) funcs;
+  add_string buffer "};\n\n\
+     extern void caml_glfw_raise_if_error(void);\n\n\
+     CAMLprim value caml_glfwGLResolve(CAMLvoid)\n\
+     {\n\
+    \    CAMLparam0();\n\
+    \    CAMLlocal2(ret, name);\n\
+    \    int i;\n\n\
+    \    ret = Val_emptylist;\n\
+    \    for (i = GL_FUNCTION_COUNT - 1; i >= 0; --i)\n\
+    \    {\n\
+    \        value tmp;\n\
+    \        gl_functions[i] = glfwGetProcAddress(gl_names[i]);\n\
+    \        if (gl_functions[i] != NULL)\n\
+    \            continue;\n\
+    \        gl_functions[i] = gl_traps[i];\n\
+    \        name = caml_copy_string(gl_names[i]);\n\
+    \        tmp = caml_alloc_small(2, 0);\n\
+    \        Field(tmp, 0) = name;\n\
+    \        Field(tmp, 1) = ret;\n\
+    \        ret = tmp;\n\
+    \    }\n\
+    \    caml_glfw_raise_if_error();\n\
+    \    CAMLreturn(ret);\n\
+     }\n";
+  List.iteri (generate_stub buffer) funcs
+
+let write file generate =
+  let channel =
+    open_out_gen [Open_creat; Open_trunc; Open_wronly] 0o664 file
+  in
+  let buffer = Buffer.create 32768 in
+  generate buffer;
+  Buffer.output_buffer channel buffer;
+  close_out_noerr channel
+
+let () =
+  let consts, funcs = read_spec Sys.argv.(1) in
+  write "GLFW_GL.ml" (fun buffer -> generate_ml buffer consts funcs);
+  write "GLFW_GL.mli" (fun buffer -> generate_mli buffer consts funcs);
+  write "GLFW_GL_stubs.c" (fun buffer -> generate_c buffer funcs)